@@ -0,0 +1,95 @@
+// Measures the throughput of the lexer in MB/s. Lexes the given source file,
+// or a generated one if none is given, a number of times on one thread.
+//
+// Usage: lexer_bench [<source_file>] [-n <iterations>]
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <string>
+
+#include "lexer.h"
+
+using namespace syscall;
+
+namespace {
+// Every function has identifiers, keywords, numbers, comments and most of the
+// operators, so that every path of the lexer is exercised.
+std::string generateSource(unsigned functionCount) {
+  std::string source;
+  for (unsigned i = 0; i < functionCount; ++i) {
+    source += "fn foo" + std::to_string(i) +
+              "(a: number, b_2: number): number { // comment here\n"
+              "  let x = a + 12.5 * b_2 < 3 && @print(main);\n"
+              "  return log;\n"
+              "}\n";
+  }
+
+  return source;
+}
+
+std::optional<SourceFile> loadSource(const char *path) {
+  if (path) {
+    llvm::Expected<SourceFile> file = SourceFile::open(path);
+    if (!file) {
+      std::fprintf(stderr, "error: failed to open '%s': %s\n", path,
+                   llvm::toString(file.takeError()).c_str());
+      return std::nullopt;
+    }
+
+    return std::move(*file);
+  }
+
+  std::unique_ptr<llvm::MemoryBuffer> buffer =
+      llvm::MemoryBuffer::getMemBufferCopy(generateSource(200000),
+                                           "<generated>");
+  std::optional<uint32_t> startOffset =
+      SourceManager::get().addFile("<generated>", buffer->getBuffer());
+  if (!startOffset)
+    return std::nullopt;
+
+  return SourceFile("<generated>", std::move(buffer), *startOffset);
+}
+} // namespace
+
+int main(int argc, const char **argv) {
+  const char *path = nullptr;
+  unsigned iterations = 20;
+
+  for (int idx = 1; idx < argc; ++idx) {
+    llvm::StringRef arg = argv[idx];
+    if (arg == "-n") {
+      if (++idx >= argc || !llvm::to_integer(argv[idx], iterations) ||
+          iterations == 0) {
+        std::fprintf(stderr, "error: expected number of iterations\n");
+        return 1;
+      }
+    } else {
+      path = argv[idx];
+    }
+  }
+
+  std::optional<SourceFile> source = loadSource(path);
+  if (!source)
+    return 1;
+
+  size_t tokenCount = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    Lexer lexer(*source);
+    while (lexer.getNextToken().kind != TokenKind::Eof)
+      ++tokenCount;
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  double megabytes = static_cast<double>(source->buffer.size()) * iterations /
+                     1e6;
+  std::printf("%zu bytes, %zu tokens, %u iterations: %.1f MB/s\n",
+              source->buffer.size(), tokenCount / iterations, iterations,
+              megabytes / elapsed.count());
+  return 0;
+}
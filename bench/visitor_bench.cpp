@@ -0,0 +1,117 @@
+// Measures the cost of dispatching on the type of an AST node. Walks a
+// generated expression tree once with a chain of dynamic_casts, the way the
+// passes used to dispatch, and once with an ASTVisitor, then prints the time
+// each of them spends per node.
+//
+// Usage: visitor_bench [-depth <depth>] [-n <iterations>]
+
+#include <llvm/ADT/StringExtras.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include "ast_visitor.h"
+
+using namespace syscall;
+
+namespace {
+ASTPtr<Expr> buildTree(ASTContext &ctx, unsigned depth, std::mt19937 &rng) {
+  if (depth == 0) {
+    if (rng() % 2)
+      return ctx.create<NumberLiteral>(SourceLocation{}, 1.0);
+    return ctx.create<DeclRefExpr>(SourceLocation{}, ctx.intern("x"));
+  }
+
+  switch (rng() % 3) {
+  case 0:
+    return ctx.create<GroupingExpr>(SourceLocation{},
+                                    buildTree(ctx, depth - 1, rng));
+  case 1:
+    return ctx.create<UnaryOperator>(SourceLocation{}, TokenKind::Minus,
+                                     buildTree(ctx, depth - 1, rng));
+  default:
+    return ctx.create<BinaryOperator>(SourceLocation{},
+                                      buildTree(ctx, depth - 1, rng),
+                                      buildTree(ctx, depth - 1, rng),
+                                      TokenKind::Plus);
+  }
+}
+
+size_t countWithDynamicCast(const Expr &expr) {
+  if (dynamic_cast<const NumberLiteral *>(&expr))
+    return 1;
+  if (auto *grouping = dynamic_cast<const GroupingExpr *>(&expr))
+    return 1 + countWithDynamicCast(*grouping->expr);
+  if (auto *binop = dynamic_cast<const BinaryOperator *>(&expr))
+    return 1 + countWithDynamicCast(*binop->lhs) +
+           countWithDynamicCast(*binop->rhs);
+  if (auto *unop = dynamic_cast<const UnaryOperator *>(&expr))
+    return 1 + countWithDynamicCast(*unop->operand);
+  if (dynamic_cast<const DeclRefExpr *>(&expr))
+    return 1;
+
+  return 0;
+}
+
+struct NodeCounter : ASTVisitor<NodeCounter, size_t> {
+  size_t visitExpr(const Expr &) { return 1; }
+  size_t visitGroupingExpr(const GroupingExpr &grouping) {
+    return 1 + visit(*grouping.expr);
+  }
+  size_t visitBinaryOperator(const BinaryOperator &binop) {
+    return 1 + visit(*binop.lhs) + visit(*binop.rhs);
+  }
+  size_t visitUnaryOperator(const UnaryOperator &unop) {
+    return 1 + visit(*unop.operand);
+  }
+};
+
+template <typename Fn> double measureNsPerNode(unsigned iterations, Fn count) {
+  size_t nodeCount = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < iterations; ++i)
+    nodeCount += count();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  return elapsed.count() / nodeCount;
+}
+} // namespace
+
+int main(int argc, const char **argv) {
+  unsigned depth = 24;
+  unsigned iterations = 2000;
+
+  for (int idx = 1; idx < argc; ++idx) {
+    llvm::StringRef arg = argv[idx];
+    unsigned *value = arg == "-depth" ? &depth : arg == "-n" ? &iterations
+                                                             : nullptr;
+    if (!value || ++idx >= argc || !llvm::to_integer(argv[idx], *value) ||
+        *value == 0) {
+      std::fprintf(stderr, "usage: visitor_bench [-depth <depth>] "
+                           "[-n <iterations>]\n");
+      return 1;
+    }
+  }
+
+  ASTContext ctx;
+  std::mt19937 rng(42);
+  ASTPtr<Expr> root = buildTree(ctx, depth, rng);
+
+  size_t nodeCount = NodeCounter().visit(*root);
+  if (countWithDynamicCast(*root) != nodeCount) {
+    std::fprintf(stderr, "error: the walks visited different nodes\n");
+    return 1;
+  }
+
+  double dynamicCastNs = measureNsPerNode(
+      iterations, [&] { return countWithDynamicCast(*root); });
+  double visitorNs =
+      measureNsPerNode(iterations, [&] { return NodeCounter().visit(*root); });
+
+  std::printf("%zu nodes, %u iterations: dynamic_cast %.2f ns/node, "
+              "visitor %.2f ns/node\n",
+              nodeCount, iterations, dynamicCastNs, visitorNs);
+  return 0;
+}
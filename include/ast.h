@@ -1,15 +1,60 @@
 #ifndef SYSCALL_AST_H
 #define SYSCALL_AST_H
 
+#include <llvm/Support/Allocator.h>
 #include <llvm/Support/ErrorHandling.h>
 
+#include <cassert>
 #include <memory>
+#include <optional>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "lexer.h"
+#include "string_interner.h"
 #include "utils.h"
 
-namespace yl {
+namespace syscall {
+// Runs the destructor of a node without freeing its memory, which belongs to
+// the ASTContext the node was allocated in. Nodes own vectors and strings
+// that live outside of the arena, so destroying a tree still visits all of
+// its nodes and takes time linear in its size; the arena only saves the
+// individual frees of the nodes themselves.
+struct ArenaDeleter {
+  template <typename T> void operator()(T *node) const { node->~T(); }
+};
+
+template <typename T> using ASTPtr = std::unique_ptr<T, ArenaDeleter>;
+
+// Owns the memory of every node of a translation unit, and the names they
+// refer to. Nodes are bump allocated, and all of them are released at once
+// when the context is destroyed, so it must outlive every tree built in it.
+class ASTContext {
+  llvm::BumpPtrAllocator allocator;
+  StringInterner ownInterner;
+  StringInterner *interner = &ownInterner;
+
+public:
+  ASTContext() = default;
+  // Allocates nodes in an arena of its own, but interns names in 'names', so
+  // that the symbols of both contexts can be compared. 'names' must outlive
+  // this context.
+  explicit ASTContext(ASTContext &names)
+      : interner(names.interner) {}
+  ASTContext(const ASTContext &) = delete;
+  ASTContext &operator=(const ASTContext &) = delete;
+
+  template <typename T, typename... Args> ASTPtr<T> create(Args &&...args) {
+    void *memory = allocator.Allocate(sizeof(T), alignof(T));
+    return ASTPtr<T>(new (memory) T(std::forward<Args>(args)...));
+  }
+
+  Symbol intern(std::string_view name) { return interner->intern(name); }
+
+  size_t getBytesAllocated() const { return allocator.getBytesAllocated(); }
+};
+
 struct Type {
   enum class Kind { Void, Number, Custom };
 
@@ -27,37 +72,82 @@ private:
 };
 
 struct Decl {
+  enum class Kind { FunctionDecl, ParamDecl, VarDecl, MainFunctionDecl };
+
+  Kind kind;
   SourceLocation location;
-  std::string identifier;
+  Symbol identifier;
 
-  Decl(SourceLocation location, std::string identifier)
-      : location(location),
-        identifier(std::move(identifier)) {}
+  Decl(Kind kind, SourceLocation location, Symbol identifier)
+      : kind(kind),
+        location(location),
+        identifier(identifier) {}
   virtual ~Decl() = default;
 
+  Kind getKind() const { return kind; }
+
+  // The type of the declared entity. The type of a variable declared without
+  // one is only known after Sema inferred it from the initializer.
+  const Type &getType() const;
+
   virtual void dump(size_t level = 0) const = 0;
 };
 
 struct Stmt {
+  // Expressions are kept together, so that 'Expr::classof' is a range check.
+  enum class Kind {
+    IfStmt,
+    WhileStmt,
+    ReturnStmt,
+    BreakStmt,
+    ContinueStmt,
+    DeclStmt,
+    Assignment,
+    NumberLiteral,
+    DeclRefExpr,
+    CallExpr,
+    GroupingExpr,
+    BinaryOperator,
+    UnaryOperator,
+    ReadRegisterExpr,
+    LogExpr,
+
+    FirstExpr = NumberLiteral,
+    LastExpr = LogExpr
+  };
+
+  Kind kind;
   SourceLocation location;
-  Stmt(SourceLocation location)
-      : location(location) {}
 
+  Stmt(Kind kind, SourceLocation location)
+      : kind(kind),
+        location(location) {}
   virtual ~Stmt() = default;
 
+  Kind getKind() const { return kind; }
+
   virtual void dump(size_t level = 0) const = 0;
 };
 
-struct Expr : public Stmt {
-  Expr(SourceLocation location)
-      : Stmt(location) {}
+// Sema annotates expressions in place with their type, and the constant
+// expression evaluator caches their value in them.
+struct Expr : public Stmt, public ConstantValueContainer<double> {
+  Type type = Type::builtinVoid();
+
+  Expr(Kind kind, SourceLocation location)
+      : Stmt(kind, location) {}
+
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() >= Kind::FirstExpr &&
+           stmt->getKind() <= Kind::LastExpr;
+  }
 };
 
 struct Block {
   SourceLocation location;
-  std::vector<std::unique_ptr<Stmt>> statements;
+  std::vector<ASTPtr<Stmt>> statements;
 
-  Block(SourceLocation location, std::vector<std::unique_ptr<Stmt>> statements)
+  Block(SourceLocation location, std::vector<ASTPtr<Stmt>> statements)
       : location(location),
         statements(std::move(statements)) {}
 
@@ -65,93 +155,179 @@ struct Block {
 };
 
 struct IfStmt : public Stmt {
-  std::unique_ptr<Expr> condition;
-  std::unique_ptr<Block> trueBlock;
-  std::unique_ptr<Block> falseBlock;
+  ASTPtr<Expr> condition;
+  ASTPtr<Block> trueBlock;
+  ASTPtr<Block> falseBlock;
 
   IfStmt(SourceLocation location,
-         std::unique_ptr<Expr> condition,
-         std::unique_ptr<Block> trueBlock,
-         std::unique_ptr<Block> falseBlock = nullptr)
-      : Stmt(location),
+         ASTPtr<Expr> condition,
+         ASTPtr<Block> trueBlock,
+         ASTPtr<Block> falseBlock = nullptr)
+      : Stmt(Kind::IfStmt, location),
         condition(std::move(condition)),
         trueBlock(std::move(trueBlock)),
         falseBlock(std::move(falseBlock)) {}
 
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::IfStmt;
+  }
+
+  void dump(size_t level = 0) const override;
+};
+
+struct WhileStmt : public Stmt {
+  ASTPtr<Expr> condition;
+  ASTPtr<Block> body;
+
+  WhileStmt(SourceLocation location,
+            ASTPtr<Expr> condition,
+            ASTPtr<Block> body)
+      : Stmt(Kind::WhileStmt, location),
+        condition(std::move(condition)),
+        body(std::move(body)) {}
+
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::WhileStmt;
+  }
+
   void dump(size_t level = 0) const override;
 };
 
 struct ReturnStmt : public Stmt {
-  std::unique_ptr<Expr> expr;
+  ASTPtr<Expr> expr;
 
-  ReturnStmt(SourceLocation location, std::unique_ptr<Expr> expr = nullptr)
-      : Stmt(location),
+  ReturnStmt(SourceLocation location, ASTPtr<Expr> expr = nullptr)
+      : Stmt(Kind::ReturnStmt, location),
         expr(std::move(expr)) {}
 
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::ReturnStmt;
+  }
+
+  void dump(size_t level = 0) const override;
+};
+
+struct BreakStmt : public Stmt {
+  BreakStmt(SourceLocation location)
+      : Stmt(Kind::BreakStmt, location) {}
+
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::BreakStmt;
+  }
+
+  void dump(size_t level = 0) const override;
+};
+
+struct ContinueStmt : public Stmt {
+  ContinueStmt(SourceLocation location)
+      : Stmt(Kind::ContinueStmt, location) {}
+
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::ContinueStmt;
+  }
+
   void dump(size_t level = 0) const override;
 };
 
 struct NumberLiteral : public Expr {
-  std::string value;
+  double value;
 
-  NumberLiteral(SourceLocation location, std::string value)
-      : Expr(location),
+  NumberLiteral(SourceLocation location, double value)
+      : Expr(Kind::NumberLiteral, location),
         value(value) {}
 
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::NumberLiteral;
+  }
+
   void dump(size_t level = 0) const override;
 };
 
 struct DeclRefExpr : public Expr {
-  std::string identifier;
+  Symbol identifier;
+  // The declaration the name refers to, set by Sema.
+  const Decl *decl = nullptr;
 
-  DeclRefExpr(SourceLocation location, std::string identifier)
-      : Expr(location),
+  DeclRefExpr(SourceLocation location, Symbol identifier)
+      : Expr(Kind::DeclRefExpr, location),
         identifier(identifier) {}
 
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::DeclRefExpr;
+  }
+
+  void dump(size_t level = 0) const override;
+};
+
+struct FunctionDecl;
+
+struct CallExpr : public Expr {
+  ASTPtr<Expr> callee;
+  std::vector<ASTPtr<Expr>> arguments;
+  // The called function, set by Sema.
+  const FunctionDecl *calleeDecl = nullptr;
+
+  CallExpr(SourceLocation location,
+           ASTPtr<Expr> callee,
+           std::vector<ASTPtr<Expr>> arguments)
+      : Expr(Kind::CallExpr, location),
+        callee(std::move(callee)),
+        arguments(std::move(arguments)) {}
+
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::CallExpr;
+  }
+
+  void dump(size_t level = 0) const override;
+};
+
+struct GroupingExpr : public Expr {
+  ASTPtr<Expr> expr;
+
+  GroupingExpr(SourceLocation location, ASTPtr<Expr> expr)
+      : Expr(Kind::GroupingExpr, location),
+        expr(std::move(expr)) {}
+
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::GroupingExpr;
+  }
+
   void dump(size_t level = 0) const override;
 };
 
 struct BinaryOperator : public Expr {
-  std::unique_ptr<Expr> lhs;
-  std::unique_ptr<Expr> rhs;
+  ASTPtr<Expr> lhs;
+  ASTPtr<Expr> rhs;
   TokenKind op;
 
   BinaryOperator(SourceLocation location,
-                 std::unique_ptr<Expr> lhs,
-                 std::unique_ptr<Expr> rhs,
+                 ASTPtr<Expr> lhs,
+                 ASTPtr<Expr> rhs,
                  TokenKind op)
-      : Expr(location),
+      : Expr(Kind::BinaryOperator, location),
         lhs(std::move(lhs)),
         rhs(std::move(rhs)),
         op(op) {}
 
-  void dump(size_t level = 0) const override;
-};
-
-struct CallExpr : public Expr {
-  std::unique_ptr<Expr> callee;
-  std::vector<std::unique_ptr<Expr>> arguments;
-
-  CallExpr(SourceLocation location,
-           std::unique_ptr<Expr> callee,
-           std::vector<std::unique_ptr<Expr>> arguments)
-      : Expr(location),
-        callee(std::move(callee)),
-        arguments(std::move(arguments)) {}
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::BinaryOperator;
+  }
 
   void dump(size_t level = 0) const override;
 };
 
-struct Assignment : public Stmt {
-  std::unique_ptr<DeclRefExpr> variable;
-  std::unique_ptr<Expr> expr;
+struct UnaryOperator : public Expr {
+  TokenKind op;
+  ASTPtr<Expr> operand;
 
-  Assignment(SourceLocation location,
-             std::unique_ptr<DeclRefExpr> variable,
-             std::unique_ptr<Expr> expr)
-      : Stmt(location),
-        variable(std::move(variable)),
-        expr(std::move(expr)) {}
+  UnaryOperator(SourceLocation location, TokenKind op, ASTPtr<Expr> operand)
+      : Expr(Kind::UnaryOperator, location),
+        op(op),
+        operand(std::move(operand)) {}
+
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::UnaryOperator;
+  }
 
   void dump(size_t level = 0) const override;
 };
@@ -160,38 +336,160 @@ struct ReadRegisterExpr : public Expr {
   std::string address;
 
   ReadRegisterExpr(SourceLocation location, std::string address)
-      : Expr(location),
+      : Expr(Kind::ReadRegisterExpr, location),
         address(address) {}
 
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::ReadRegisterExpr;
+  }
+
   void dump(size_t level = 0) const override;
 };
 
 struct LogExpr : public Expr {
-  std::unique_ptr<Expr> expr;
+  ASTPtr<Expr> expr;
 
-  LogExpr(SourceLocation location, std::unique_ptr<Expr> expr)
-      : Expr(location),
+  LogExpr(SourceLocation location, ASTPtr<Expr> expr)
+      : Expr(Kind::LogExpr, location),
         expr(std::move(expr)) {}
 
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::LogExpr;
+  }
+
+  void dump(size_t level = 0) const override;
+};
+
+struct ParamDecl : public Decl {
+  Type type;
+
+  ParamDecl(SourceLocation location, Symbol identifier, Type type)
+      : Decl(Kind::ParamDecl, location, identifier),
+        type(std::move(type)) {}
+
+  static bool classof(const Decl *decl) {
+    return decl->getKind() == Kind::ParamDecl;
+  }
+
+  void dump(size_t level = 0) const override;
+};
+
+struct VarDecl : public Decl {
+  // Filled in by Sema if the type is inferred from the initializer.
+  std::optional<Type> type;
+  bool isMutable;
+  ASTPtr<Expr> initializer;
+
+  VarDecl(SourceLocation location,
+          Symbol identifier,
+          std::optional<Type> type,
+          bool isMutable,
+          ASTPtr<Expr> initializer = nullptr)
+      : Decl(Kind::VarDecl, location, identifier),
+        type(std::move(type)),
+        isMutable(isMutable),
+        initializer(std::move(initializer)) {}
+
+  static bool classof(const Decl *decl) {
+    return decl->getKind() == Kind::VarDecl;
+  }
+
+  void dump(size_t level = 0) const override;
+};
+
+struct FunctionDecl : public Decl {
+  Type type;
+  std::vector<ASTPtr<ParamDecl>> params;
+  ASTPtr<Block> body;
+
+  FunctionDecl(SourceLocation location,
+               Symbol identifier,
+               Type type,
+               std::vector<ASTPtr<ParamDecl>> params,
+               ASTPtr<Block> body)
+      : Decl(Kind::FunctionDecl, location, identifier),
+        type(std::move(type)),
+        params(std::move(params)),
+        body(std::move(body)) {}
+
+  static bool classof(const Decl *decl) {
+    return decl->getKind() == Kind::FunctionDecl;
+  }
+
   void dump(size_t level = 0) const override;
 };
 
 struct MainFunctionDecl : public Decl {
-  std::unique_ptr<Block> body;
+  ASTPtr<Block> body;
 
-  MainFunctionDecl(SourceLocation location, std::unique_ptr<Block> body)
-      : Decl(location, "main"),
+  MainFunctionDecl(SourceLocation location,
+                   Symbol identifier,
+                   ASTPtr<Block> body)
+      : Decl(Kind::MainFunctionDecl, location, identifier),
         body(std::move(body)) {}
 
+  static bool classof(const Decl *decl) {
+    return decl->getKind() == Kind::MainFunctionDecl;
+  }
+
+  void dump(size_t level = 0) const override;
+};
+
+struct DeclStmt : public Stmt {
+  ASTPtr<VarDecl> varDecl;
+
+  DeclStmt(SourceLocation location, ASTPtr<VarDecl> varDecl)
+      : Stmt(Kind::DeclStmt, location),
+        varDecl(std::move(varDecl)) {}
+
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::DeclStmt;
+  }
+
   void dump(size_t level = 0) const override;
 };
 
+struct Assignment : public Stmt {
+  ASTPtr<DeclRefExpr> variable;
+  ASTPtr<Expr> expr;
+
+  Assignment(SourceLocation location,
+             ASTPtr<DeclRefExpr> variable,
+             ASTPtr<Expr> expr)
+      : Stmt(Kind::Assignment, location),
+        variable(std::move(variable)),
+        expr(std::move(expr)) {}
+
+  static bool classof(const Stmt *stmt) {
+    return stmt->getKind() == Kind::Assignment;
+  }
+
+  void dump(size_t level = 0) const override;
+};
+
+inline const Type &Decl::getType() const {
+  switch (kind) {
+    case Kind::FunctionDecl:
+      return static_cast<const FunctionDecl *>(this)->type;
+    case Kind::ParamDecl:
+      return static_cast<const ParamDecl *>(this)->type;
+    case Kind::VarDecl:
+      assert(static_cast<const VarDecl *>(this)->type &&
+             "the type of the variable hasn't been inferred yet");
+      return *static_cast<const VarDecl *>(this)->type;
+    case Kind::MainFunctionDecl:
+      break;
+  }
+
+  llvm_unreachable("declaration doesn't have a type");
+}
+
 struct Program {
-  std::vector<std::unique_ptr<Decl>> declarations;
+  std::vector<ASTPtr<Decl>> declarations;
 
   void dump(size_t level = 0) const;
 };
 
-} // namespace yl
+} // namespace syscall
 
 #endif // SYSCALL_AST_H
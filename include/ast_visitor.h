@@ -0,0 +1,139 @@
+#ifndef SYSCALL_AST_VISITOR_H
+#define SYSCALL_AST_VISITOR_H
+
+#include <llvm/Support/Casting.h>
+#include <llvm/Support/ErrorHandling.h>
+
+#include "ast.h"
+
+namespace syscall {
+namespace detail {
+template <typename T> using ConstRef = const T &;
+template <typename T> using MutableRef = T &;
+
+// Dispatches a statement to the 'visit<Class>' method of 'Derived' that
+// belongs to its dynamic type, with a single switch on the kind of the node.
+// Every visit method falls back to the one of the parent class, up to
+// 'visitStmt', so a pass only has to implement the nodes it cares about. The
+// trailing arguments of 'visit' are forwarded to the visit methods.
+template <template <typename> class Ref,
+          typename Derived,
+          typename RetTy,
+          typename... ParamTys>
+class ASTVisitorBase {
+  Derived &derived() { return *static_cast<Derived *>(this); }
+
+public:
+  RetTy visit(Ref<Stmt> stmt, ParamTys... params) {
+    switch (stmt.getKind()) {
+      case Stmt::Kind::IfStmt:
+        return derived().visitIfStmt(llvm::cast<IfStmt>(stmt), params...);
+      case Stmt::Kind::WhileStmt:
+        return derived().visitWhileStmt(llvm::cast<WhileStmt>(stmt), params...);
+      case Stmt::Kind::ReturnStmt:
+        return derived().visitReturnStmt(llvm::cast<ReturnStmt>(stmt),
+                                         params...);
+      case Stmt::Kind::BreakStmt:
+        return derived().visitBreakStmt(llvm::cast<BreakStmt>(stmt), params...);
+      case Stmt::Kind::ContinueStmt:
+        return derived().visitContinueStmt(llvm::cast<ContinueStmt>(stmt),
+                                           params...);
+      case Stmt::Kind::DeclStmt:
+        return derived().visitDeclStmt(llvm::cast<DeclStmt>(stmt), params...);
+      case Stmt::Kind::Assignment:
+        return derived().visitAssignment(llvm::cast<Assignment>(stmt),
+                                         params...);
+      case Stmt::Kind::NumberLiteral:
+        return derived().visitNumberLiteral(llvm::cast<NumberLiteral>(stmt),
+                                            params...);
+      case Stmt::Kind::DeclRefExpr:
+        return derived().visitDeclRefExpr(llvm::cast<DeclRefExpr>(stmt),
+                                          params...);
+      case Stmt::Kind::CallExpr:
+        return derived().visitCallExpr(llvm::cast<CallExpr>(stmt), params...);
+      case Stmt::Kind::GroupingExpr:
+        return derived().visitGroupingExpr(llvm::cast<GroupingExpr>(stmt),
+                                           params...);
+      case Stmt::Kind::BinaryOperator:
+        return derived().visitBinaryOperator(llvm::cast<BinaryOperator>(stmt),
+                                             params...);
+      case Stmt::Kind::UnaryOperator:
+        return derived().visitUnaryOperator(llvm::cast<UnaryOperator>(stmt),
+                                            params...);
+      case Stmt::Kind::ReadRegisterExpr:
+        return derived().visitReadRegisterExpr(
+            llvm::cast<ReadRegisterExpr>(stmt), params...);
+      case Stmt::Kind::LogExpr:
+        return derived().visitLogExpr(llvm::cast<LogExpr>(stmt), params...);
+    }
+
+    llvm_unreachable("unknown statement kind");
+  }
+
+  RetTy visitStmt(Ref<Stmt>, ParamTys...) { return RetTy(); }
+  RetTy visitExpr(Ref<Expr> expr, ParamTys... params) {
+    return derived().visitStmt(expr, params...);
+  }
+
+  RetTy visitIfStmt(Ref<IfStmt> stmt, ParamTys... params) {
+    return derived().visitStmt(stmt, params...);
+  }
+  RetTy visitWhileStmt(Ref<WhileStmt> stmt, ParamTys... params) {
+    return derived().visitStmt(stmt, params...);
+  }
+  RetTy visitReturnStmt(Ref<ReturnStmt> stmt, ParamTys... params) {
+    return derived().visitStmt(stmt, params...);
+  }
+  RetTy visitBreakStmt(Ref<BreakStmt> stmt, ParamTys... params) {
+    return derived().visitStmt(stmt, params...);
+  }
+  RetTy visitContinueStmt(Ref<ContinueStmt> stmt, ParamTys... params) {
+    return derived().visitStmt(stmt, params...);
+  }
+  RetTy visitDeclStmt(Ref<DeclStmt> stmt, ParamTys... params) {
+    return derived().visitStmt(stmt, params...);
+  }
+  RetTy visitAssignment(Ref<Assignment> stmt, ParamTys... params) {
+    return derived().visitStmt(stmt, params...);
+  }
+
+  RetTy visitNumberLiteral(Ref<NumberLiteral> expr, ParamTys... params) {
+    return derived().visitExpr(expr, params...);
+  }
+  RetTy visitDeclRefExpr(Ref<DeclRefExpr> expr, ParamTys... params) {
+    return derived().visitExpr(expr, params...);
+  }
+  RetTy visitCallExpr(Ref<CallExpr> expr, ParamTys... params) {
+    return derived().visitExpr(expr, params...);
+  }
+  RetTy visitGroupingExpr(Ref<GroupingExpr> expr, ParamTys... params) {
+    return derived().visitExpr(expr, params...);
+  }
+  RetTy visitBinaryOperator(Ref<BinaryOperator> expr, ParamTys... params) {
+    return derived().visitExpr(expr, params...);
+  }
+  RetTy visitUnaryOperator(Ref<UnaryOperator> expr, ParamTys... params) {
+    return derived().visitExpr(expr, params...);
+  }
+  RetTy visitReadRegisterExpr(Ref<ReadRegisterExpr> expr, ParamTys... params) {
+    return derived().visitExpr(expr, params...);
+  }
+  RetTy visitLogExpr(Ref<LogExpr> expr, ParamTys... params) {
+    return derived().visitExpr(expr, params...);
+  }
+};
+} // namespace detail
+
+// Visits the tree without modifying it.
+template <typename Derived, typename RetTy = void, typename... ParamTys>
+using ASTVisitor =
+    detail::ASTVisitorBase<detail::ConstRef, Derived, RetTy, ParamTys...>;
+
+// Visits the tree with mutable access to the nodes, which is how Sema
+// annotates them.
+template <typename Derived, typename RetTy = void, typename... ParamTys>
+using MutableASTVisitor =
+    detail::ASTVisitorBase<detail::MutableRef, Derived, RetTy, ParamTys...>;
+} // namespace syscall
+
+#endif // SYSCALL_AST_VISITOR_H
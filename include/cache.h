@@ -0,0 +1,64 @@
+#ifndef SYSCALL_CACHE_H
+#define SYSCALL_CACHE_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace syscall {
+
+// A persistent, content-addressed store of object files shared by every
+// compiler invocation that uses the same directory. Entries are keyed by a
+// SHA-256 of the compiler binary's identity, the code generation flags and
+// the source bytes, so an unchanged input can skip every compilation phase.
+class CompilationCache {
+  std::filesystem::path directory;
+
+  std::filesystem::path getEntryPath(const std::string &key) const;
+
+public:
+  // Holds the per-entry lock file. While it is alive, other processes
+  // (and threads) asking for the same key wait, then find the stored object.
+  // The lock file is removed when the lock is released, so the directory
+  // only keeps lock files of entries that are being compiled.
+  class EntryLock {
+    std::string key;
+    std::string lockPath;
+    int fd = -1;
+
+  public:
+    EntryLock(std::string key, std::string lockPath, int fd)
+        : key(std::move(key)),
+          lockPath(std::move(lockPath)),
+          fd(fd) {}
+    EntryLock(EntryLock &&other)
+        : key(std::move(other.key)),
+          lockPath(std::move(other.lockPath)),
+          fd(other.fd) {
+      other.key.clear();
+      other.fd = -1;
+    }
+    EntryLock(const EntryLock &) = delete;
+    ~EntryLock();
+  };
+
+  explicit CompilationCache(std::filesystem::path directory)
+      : directory(std::move(directory)) {}
+
+  // Creates the cache directory if needed, returns false on failure.
+  bool initialize() const;
+
+  static std::string computeKey(std::string_view source,
+                                llvm::ArrayRef<std::string> flags);
+
+  EntryLock lock(const std::string &key) const;
+  bool load(const std::string &key, llvm::SmallVectorImpl<char> &object) const;
+  void store(const std::string &key, llvm::ArrayRef<char> object) const;
+};
+
+} // namespace syscall
+
+#endif // SYSCALL_CACHE_H
@@ -5,23 +5,16 @@
 #include <vector>
 
 #include "ast.h"
+#include "ast_visitor.h"
 #include "constexpr.h"
 
 namespace syscall {
 
-// Forward declarations for Syscall-specific types
-struct SyscallExpr;
-struct SyscallStmt;
-struct SyscallFunctionDecl;
-struct SyscallBlock;
-struct SyscallIfStmt;
-struct SyscallWhileStmt;
-
 // Represents a basic block in the control flow graph
 struct BasicBlock {
   std::set<std::pair<int, bool>> predecessors; // (blockIndex, isEdgeReachable)
   std::set<std::pair<int, bool>> successors;   // (blockIndex, isEdgeReachable)
-  std::vector<const SyscallStmt *> statements; // Statements within the block
+  std::vector<const Stmt *> statements; // Statements within the block
 };
 
 // Represents the entire control flow graph
@@ -50,7 +43,7 @@ struct CFG {
   }
 
   // Insert a statement into a specific block
-  void insertStmt(const SyscallStmt *stmt, int block) {
+  void insertStmt(const Stmt *stmt, int block) {
     basicBlocks[block].statements.emplace_back(stmt);
   }
 
@@ -58,38 +51,51 @@ struct CFG {
   void dump() const;
 };
 
-// Builder for generating a CFG from Syscall function declarations
-class CFGBuilder {
+// Builder for generating a CFG from Syscall function declarations. The
+// visit methods insert a statement in front of the given block, and return
+// the block that control enters the statement from.
+class CFGBuilder : public ASTVisitor<CFGBuilder, int, int> {
+  friend ASTVisitor<CFGBuilder, int, int>;
+
   ConstantExpressionEvaluator cee; // Expression evaluator
   CFG cfg;                         // Control flow graph being built
 
   // Insert a block with a given successor
-  int insertBlock(const SyscallBlock &block, int successor);
+  int insertBlock(const Block &block, int successor);
 
   // Insert an if statement with an exit block
-  int insertIfStmt(const SyscallIfStmt &stmt, int exit);
+  int visitIfStmt(const IfStmt &stmt, int exit);
 
   // Insert a while statement with an exit block
-  int insertWhileStmt(const SyscallWhileStmt &stmt, int exit);
+  int visitWhileStmt(const WhileStmt &stmt, int exit);
 
-  // Insert a statement into a specific block
-  int insertStmt(const SyscallStmt &stmt, int block);
+  // Insert a break statement into a block
+  int visitBreakStmt(const BreakStmt &stmt, int block);
+
+  // Insert a continue statement into a block
+  int visitContinueStmt(const ContinueStmt &stmt, int block);
 
   // Insert a declaration statement into a block
-  int insertDeclStmt(const SyscallStmt &stmt, int block);
+  int visitDeclStmt(const DeclStmt &stmt, int block);
 
   // Insert an assignment into a block
-  int insertAssignment(const SyscallStmt &stmt, int block);
+  int visitAssignment(const Assignment &stmt, int block);
 
   // Insert a return statement into a block
-  int insertReturnStmt(const SyscallStmt &stmt, int block);
+  int visitReturnStmt(const ReturnStmt &stmt, int block);
+
+  // Insert an expression without subexpressions into a block
+  int visitExpr(const Expr &expr, int block);
 
-  // Insert an expression into a block
-  int insertExpr(const SyscallExpr &expr, int block);
+  // Insert an expression and its subexpressions into a block
+  int visitCallExpr(const CallExpr &call, int block);
+  int visitGroupingExpr(const GroupingExpr &grouping, int block);
+  int visitBinaryOperator(const BinaryOperator &binop, int block);
+  int visitUnaryOperator(const UnaryOperator &unop, int block);
 
 public:
   // Build a CFG from a Syscall function declaration
-  CFG build(const SyscallFunctionDecl &fn);
+  CFG build(const FunctionDecl &fn);
 };
 
 } // namespace syscall
@@ -1,6 +1,7 @@
 #ifndef SYSCALL_CODEGEN_H
 #define SYSCALL_CODEGEN_H
 
+#include <llvm/ADT/ArrayRef.h>
 #include <llvm/IR/IRBuilder.h>
 
 #include <map>
@@ -8,57 +9,72 @@
 #include <vector>
 
 #include "ast.h"
+#include "ast_visitor.h"
 
 namespace syscall {
 
-class Codegen {
-  std::vector<std::unique_ptr<SyscallFunctionDecl>> resolvedTree; // Updated type for Syscall
-  std::map<const SyscallDecl *, llvm::Value *> declarations;     // Updated type for Syscall
+class Codegen : public ASTVisitor<Codegen, llvm::Value *> {
+  friend ASTVisitor<Codegen, llvm::Value *>;
+
+  llvm::ArrayRef<ASTPtr<FunctionDecl>> resolvedTree;
+  std::map<const Decl *, llvm::Value *> declarations;
 
   llvm::Value *retVal = nullptr;
   llvm::BasicBlock *retBB = nullptr;
   llvm::Instruction *allocaInsertPoint;
 
-  llvm::LLVMContext context;
+  llvm::LLVMContext &context;
   llvm::IRBuilder<> builder;
-  llvm::Module module;
-
-  llvm::Type *generateType(SyscallType type); // Updated to SyscallType
-
-  llvm::Value *generateStmt(const SyscallStmt &stmt); // Updated type for Syscall
-  llvm::Value *generateIfStmt(const SyscallIfStmt &stmt); // Updated type for Syscall
-  llvm::Value *generateWhileStmt(const SyscallWhileStmt &stmt); // Updated type for Syscall
-  llvm::Value *generateDeclStmt(const SyscallDeclStmt &stmt); // Updated type for Syscall
-  llvm::Value *generateAssignment(const SyscallAssignment &stmt); // Updated type for Syscall
-  llvm::Value *generateReturnStmt(const SyscallReturnStmt &stmt); // Updated type for Syscall
-
-  llvm::Value *generateExpr(const SyscallExpr &expr); // Updated type for Syscall
-  llvm::Value *generateCallExpr(const SyscallCallExpr &call); // Updated type for Syscall
-  llvm::Value *generateBinaryOperator(const SyscallBinaryOperator &binop); // Updated type for Syscall
-  llvm::Value *generateUnaryOperator(const SyscallUnaryOperator &unop); // Updated type for Syscall
-
-  void generateConditionalOperator(const SyscallExpr &op,
+  std::unique_ptr<llvm::Module> module;
+
+  llvm::Type *generateType(Type type);
+
+  llvm::Value *generateStmt(const Stmt &stmt);
+  llvm::Value *visitIfStmt(const IfStmt &stmt);
+  llvm::Value *visitWhileStmt(const WhileStmt &stmt);
+  llvm::Value *visitDeclStmt(const DeclStmt &stmt);
+  llvm::Value *visitAssignment(const Assignment &stmt);
+  llvm::Value *visitReturnStmt(const ReturnStmt &stmt);
+
+  llvm::Value *generateExpr(const Expr &expr);
+  llvm::Value *visitNumberLiteral(const NumberLiteral &number);
+  llvm::Value *visitDeclRefExpr(const DeclRefExpr &dre);
+  llvm::Value *visitCallExpr(const CallExpr &call);
+  llvm::Value *visitGroupingExpr(const GroupingExpr &grouping);
+  llvm::Value *visitBinaryOperator(const BinaryOperator &binop);
+  llvm::Value *visitUnaryOperator(const UnaryOperator &unop);
+
+  void generateConditionalOperator(const Expr &op,
                                    llvm::BasicBlock *trueBlock,
-                                   llvm::BasicBlock *falseBlock); // Updated type for Syscall
+                                   llvm::BasicBlock *falseBlock);
 
   llvm::Value *doubleToBool(llvm::Value *v);
   llvm::Value *boolToDouble(llvm::Value *v);
 
   llvm::Function *getCurrentFunction();
-  llvm::AllocaInst *allocateStackVariable(const std::string_view identifier);
+  llvm::AllocaInst *allocateStackVariable(llvm::StringRef identifier);
 
-  void generateBlock(const SyscallBlock &block); // Updated type for Syscall
-  void generateFunctionBody(const SyscallFunctionDecl &functionDecl); // Updated type for Syscall
-  void generateFunctionDecl(const SyscallFunctionDecl &functionDecl); // Updated type for Syscall
+  void generateBlock(const Block &block);
+  void generateFunctionBody(const FunctionDecl &functionDecl);
+  void generateFunctionDecl(const FunctionDecl &functionDecl);
 
-  void generateBuiltinPrintlnBody(const SyscallFunctionDecl &println); // Updated type for Syscall
+  void generateBuiltinPrintlnBody(const FunctionDecl &println);
   void generateMainWrapper();
 
 public:
-  Codegen(std::vector<std::unique_ptr<SyscallFunctionDecl>> resolvedTree,
-          std::string_view sourcePath);
-
-  llvm::Module *generateIR();
+  // The tree is not copied, it has to outlive the code generator.
+  Codegen(llvm::ArrayRef<ASTPtr<FunctionDecl>> resolvedTree,
+          std::string_view sourcePath,
+          llvm::LLVMContext &context);
+
+  // The module is handed over to the caller, which has to keep 'context'
+  // alive for as long as the module is in use.
+  std::unique_ptr<llvm::Module> generateIR();
+
+  // Generates a module that defines only 'function', which has to be part of
+  // the resolved tree, and the builtins. The other functions it calls are
+  // declared, and are expected to be defined by other modules.
+  std::unique_ptr<llvm::Module> generateIR(const FunctionDecl &function);
 };
 
 } // namespace syscall
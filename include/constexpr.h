@@ -4,21 +4,29 @@
 #include <optional>
 
 #include "ast.h"
+#include "ast_visitor.h"
 
 namespace syscall {
 
-class ConstantExpressionEvaluator {
-  std::optional<double>
-  evaluateBinaryOperator(const SyscallBinaryOperator &binop,
-                         bool allowSideEffects);
-  std::optional<double> evaluateUnaryOperator(const SyscallUnaryOperator &unop,
-                                              bool allowSideEffects);
-  std::optional<double> evaluateDeclRefExpr(const SyscallDeclRefExpr &dre,
+class ConstantExpressionEvaluator
+    : public ASTVisitor<ConstantExpressionEvaluator,
+                        std::optional<double>,
+                        bool> {
+  friend ASTVisitor<ConstantExpressionEvaluator, std::optional<double>, bool>;
+
+  std::optional<double> visitNumberLiteral(const NumberLiteral &numberLiteral,
+                                           bool allowSideEffects);
+  std::optional<double> visitGroupingExpr(const GroupingExpr &grouping,
+                                          bool allowSideEffects);
+  std::optional<double> visitBinaryOperator(const BinaryOperator &binop,
                                             bool allowSideEffects);
+  std::optional<double> visitUnaryOperator(const UnaryOperator &unop,
+                                           bool allowSideEffects);
+  std::optional<double> visitDeclRefExpr(const DeclRefExpr &dre,
+                                         bool allowSideEffects);
 
 public:
-  std::optional<double> evaluate(const SyscallExpr &expr,
-                                 bool allowSideEffects);
+  std::optional<double> evaluate(const Expr &expr, bool allowSideEffects);
 };
 
 } // namespace syscall
@@ -0,0 +1,33 @@
+#ifndef SYSCALL_DATAFLOW_H
+#define SYSCALL_DATAFLOW_H
+
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/STLFunctionalExtras.h>
+
+#include <vector>
+
+#include "cfg.h"
+
+namespace syscall {
+
+// Orders the blocks so that every block comes before its successors, except
+// along back edges. The walk starts at the entry block, and the blocks it
+// can't reach follow, so that they are analyzed too.
+std::vector<int> computeReversePostOrder(const CFG &cfg);
+
+// Turns the facts entering a block into the facts leaving it, in place.
+using DataflowTransferFn =
+    llvm::function_ref<void(int block, llvm::BitVector &facts)>;
+
+// Solves a forward dataflow problem whose facts are sets of 'numBits' bits.
+// The facts entering a block are the union of the facts leaving its
+// predecessors, so any lattice that encodes its join as a union of bits fits.
+// The blocks whose predecessors changed are revisited in reverse post-order
+// until nothing changes. Returns the facts entering each block.
+std::vector<llvm::BitVector> solveForwardDataflow(const CFG &cfg,
+                                                  unsigned numBits,
+                                                  DataflowTransferFn transfer);
+
+} // namespace syscall
+
+#endif // SYSCALL_DATAFLOW_H
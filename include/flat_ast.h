@@ -0,0 +1,270 @@
+#ifndef SYSCALL_FLAT_AST_H
+#define SYSCALL_FLAT_AST_H
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "ast.h"
+
+namespace syscall {
+// Index of a node in the array of its kind, or of a name in the name table.
+using NodeIdx = uint32_t;
+constexpr NodeIdx InvalidIdx = UINT32_MAX;
+
+// Refers to a statement of a FlatAST by its kind, kept in the low bits, and
+// its index in the array of that kind.
+class StmtRef {
+  static constexpr unsigned KindBits = 4;
+
+  uint32_t bits = InvalidIdx;
+
+public:
+  // The largest index that fits next to the kind, and can't be mistaken for
+  // an invalid reference.
+  static constexpr NodeIdx MaxIndex = (1u << (32 - KindBits)) - 2;
+
+  StmtRef() = default;
+  StmtRef(Stmt::Kind kind, NodeIdx index)
+      : bits(index << KindBits | static_cast<uint32_t>(kind)) {
+    assert(index <= MaxIndex && "statement index doesn't fit in StmtRef");
+  }
+
+  bool isValid() const { return bits != InvalidIdx; }
+
+  Stmt::Kind getKind() const {
+    return static_cast<Stmt::Kind>(bits & ((1u << KindBits) - 1));
+  }
+  NodeIdx getIndex() const { return bits >> KindBits; }
+};
+
+static_assert(static_cast<unsigned>(Stmt::Kind::LastExpr) < 16,
+              "statement kinds don't fit in StmtRef");
+
+// A run of consecutive elements of one of the arrays of a FlatAST.
+struct IdxRange {
+  NodeIdx begin = 0;
+  uint32_t size = 0;
+};
+
+// The nodes of a FlatAST. They only hold indices and plain values, so the
+// arrays they live in can be written out and read back as they are. Nothing
+// in them may be left unspecified, or the same tree would give different
+// blobs: where alignment needs padding it is an explicit, zeroed member. Enums
+// that a corrupted blob could hold out of range values of are stored as
+// integers, and checked when the tree is raised.
+namespace flat {
+// A location as the offset from the start of the source file, which doesn't
+// depend on where the file is registered in the SourceManager.
+using FileOffset = uint32_t;
+
+struct Type {
+  syscall::Type::Kind kind;
+  NodeIdx name;
+};
+
+struct Block {
+  FileOffset location;
+  IdxRange statements; // in FlatAST::stmtLists
+};
+
+struct IfStmt {
+  FileOffset location;
+  StmtRef condition;
+  NodeIdx trueBlock;
+  NodeIdx falseBlock;
+};
+
+struct WhileStmt {
+  FileOffset location;
+  StmtRef condition;
+  NodeIdx body;
+};
+
+struct ReturnStmt {
+  FileOffset location;
+  StmtRef expr;
+};
+
+struct BreakStmt {
+  FileOffset location;
+};
+
+struct ContinueStmt {
+  FileOffset location;
+};
+
+struct DeclStmt {
+  FileOffset location;
+  NodeIdx varDecl;
+};
+
+struct Assignment {
+  FileOffset location;
+  StmtRef variable;
+  StmtRef expr;
+};
+
+struct NumberLiteral {
+  FileOffset location;
+  uint32_t padding;
+  double value;
+};
+
+struct DeclRefExpr {
+  FileOffset location;
+  NodeIdx identifier;
+};
+
+struct CallExpr {
+  FileOffset location;
+  StmtRef callee;
+  IdxRange arguments; // in FlatAST::stmtLists
+};
+
+struct GroupingExpr {
+  FileOffset location;
+  StmtRef expr;
+};
+
+// 'op' is the byte of a TokenKind.
+struct BinaryOperator {
+  FileOffset location;
+  StmtRef lhs;
+  StmtRef rhs;
+  uint8_t op;
+  uint8_t padding[3] = {};
+};
+
+struct UnaryOperator {
+  FileOffset location;
+  StmtRef operand;
+  uint8_t op;
+  uint8_t padding[3] = {};
+};
+
+struct ReadRegisterExpr {
+  FileOffset location;
+  NodeIdx address;
+};
+
+struct LogExpr {
+  FileOffset location;
+  StmtRef expr;
+};
+
+struct ParamDecl {
+  FileOffset location;
+  NodeIdx identifier;
+  Type type;
+};
+
+struct VarDecl {
+  FileOffset location;
+  NodeIdx identifier;
+  Type type; // 'name' is InvalidIdx if the type is inferred
+  StmtRef initializer;
+  uint8_t isMutable; // 0 or 1
+  uint8_t padding[3] = {};
+};
+
+struct FunctionDecl {
+  FileOffset location;
+  NodeIdx identifier;
+  Type type;
+  IdxRange params; // in FlatAST::paramDecls
+  NodeIdx body;
+};
+} // namespace flat
+
+// The parsed tree of a source file in contiguous per-kind arrays, with nodes
+// referring to each other by 32-bit indices instead of pointers. Statement
+// and argument lists are ranges of one shared array. It takes about half the
+// memory of the pointer based tree, traversals walk memory linearly, and the
+// whole tree can be written out as one blob and read back with a copy per
+// array.
+//
+// Locations are stored relative to the source file, so a tree read back in
+// another process refers to the same places once that file is loaded again.
+class FlatAST {
+  template <typename Self, typename Fn>
+  static void forEachArray(Self &self, Fn &&fn) {
+    fn(self.functionDecls);
+    fn(self.paramDecls);
+    fn(self.varDecls);
+    fn(self.blocks);
+    fn(self.ifStmts);
+    fn(self.whileStmts);
+    fn(self.returnStmts);
+    fn(self.breakStmts);
+    fn(self.continueStmts);
+    fn(self.declStmts);
+    fn(self.assignments);
+    fn(self.numberLiterals);
+    fn(self.declRefExprs);
+    fn(self.callExprs);
+    fn(self.groupingExprs);
+    fn(self.binaryOperators);
+    fn(self.unaryOperators);
+    fn(self.readRegisterExprs);
+    fn(self.logExprs);
+    fn(self.stmtLists);
+    fn(self.nameOffsets);
+    fn(self.nameChars);
+  }
+
+public:
+  std::vector<flat::FunctionDecl> functionDecls;
+  std::vector<flat::ParamDecl> paramDecls;
+  std::vector<flat::VarDecl> varDecls;
+  std::vector<flat::Block> blocks;
+
+  std::vector<flat::IfStmt> ifStmts;
+  std::vector<flat::WhileStmt> whileStmts;
+  std::vector<flat::ReturnStmt> returnStmts;
+  std::vector<flat::BreakStmt> breakStmts;
+  std::vector<flat::ContinueStmt> continueStmts;
+  std::vector<flat::DeclStmt> declStmts;
+  std::vector<flat::Assignment> assignments;
+
+  std::vector<flat::NumberLiteral> numberLiterals;
+  std::vector<flat::DeclRefExpr> declRefExprs;
+  std::vector<flat::CallExpr> callExprs;
+  std::vector<flat::GroupingExpr> groupingExprs;
+  std::vector<flat::BinaryOperator> binaryOperators;
+  std::vector<flat::UnaryOperator> unaryOperators;
+  std::vector<flat::ReadRegisterExpr> readRegisterExprs;
+  std::vector<flat::LogExpr> logExprs;
+
+  std::vector<StmtRef> stmtLists;
+
+  // Every name is stored once, NUL terminated, in 'nameChars'.
+  std::vector<uint32_t> nameOffsets;
+  std::vector<char> nameChars;
+
+  // Returns std::nullopt if a kind of statement has more nodes than a
+  // StmtRef can refer to.
+  static std::optional<FlatAST>
+  lower(const std::vector<ASTPtr<FunctionDecl>> &ast, const SourceFile &source);
+
+  // Rebuilds the pointer based tree in 'ctx', with the locations of 'source'.
+  // Every index and location is checked, so that a blob that doesn't belong
+  // to 'source' or is corrupted yields std::nullopt instead of a broken tree.
+  std::optional<std::vector<ASTPtr<FunctionDecl>>>
+  raise(ASTContext &ctx, const SourceFile &source) const;
+
+  // The blob is in the byte order of the host.
+  void write(llvm::raw_ostream &os) const;
+  static std::optional<FlatAST> read(llvm::StringRef blob);
+
+  llvm::StringRef getName(NodeIdx name) const {
+    return nameChars.data() + nameOffsets[name];
+  }
+};
+} // namespace syscall
+
+#endif // SYSCALL_FLAT_AST_H
@@ -1,17 +1,20 @@
 #ifndef SYSCALL_LEXER_H
 #define SYSCALL_LEXER_H
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <optional>
-#include <string>
-#include <unordered_map>
-#include <cctype>
+#include <string_view>
+#include <vector>
 
 #include "utils.h"
 
 namespace syscall {
 constexpr char singleCharTokens[] = {'\0', '(', ')', '{', '}', ':', ';',
-                                     ',',  '+', '-', '*', '<', '>', '!', '='};
+                                     ',',  '+', '-', '*', '<', '>', '!'};
 
 enum class TokenKind : char {
   Unk = -128,
@@ -25,11 +28,16 @@ enum class TokenKind : char {
   Identifier,
   Number,
 
-  KwMain,
+  KwFunction,
+  KwIf,
+  KwElse,
+  KwWhile,
+  KwLet,
+  KwVar,
+  KwReturn,
   KwAdd,
   KwPrint,
   KwLog,
-  KwReturn,
 
   Eof = singleCharTokens[0],
   Lpar = singleCharTokens[1],
@@ -44,97 +52,156 @@ enum class TokenKind : char {
   Asterisk = singleCharTokens[10],
   Lt = singleCharTokens[11],
   Gt = singleCharTokens[12],
-  Excl = singleCharTokens[13],
-  EqualSign = singleCharTokens[14]
+  Excl = singleCharTokens[13]
+};
+
+struct Keyword {
+  std::string_view spelling;
+  TokenKind kind;
 };
 
-const std::unordered_map<std::string_view, TokenKind> keywords = {
-    {"main", TokenKind::KwMain}, {"add", TokenKind::KwAdd},
-    {"print", TokenKind::KwPrint}, {"log", TokenKind::KwLog},
-    {"return", TokenKind::KwReturn}};
+// A perfect hash table built at compile time from a keyword list. The
+// constructor searches for a seed that maps every keyword to its own slot, so
+// classifying an identifier takes a single hash and at most one comparison.
+template <size_t N> class KeywordTable {
+  static constexpr size_t tableSize = [] {
+    size_t size = 1;
+    while (size < 2 * N)
+      size *= 2;
+    return size;
+  }();
+
+  std::array<Keyword, tableSize> slots{};
+  uint32_t seed = 0;
+
+  static constexpr size_t getSlot(std::string_view spelling, uint32_t seed) {
+    // FNV-1a, seeded.
+    uint32_t hash = 2166136261u ^ seed;
+    for (char c : spelling)
+      hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    return hash & (tableSize - 1);
+  }
+
+  constexpr bool tryPlace(const Keyword (&keywords)[N]) {
+    slots = {};
+    for (const Keyword &keyword : keywords) {
+      Keyword &slot = slots[getSlot(keyword.spelling, seed)];
+      if (!slot.spelling.empty())
+        return false;
+      slot = keyword;
+    }
+    return true;
+  }
+
+public:
+  constexpr explicit KeywordTable(const Keyword (&keywords)[N]) {
+    while (!tryPlace(keywords))
+      ++seed;
+  }
+
+  constexpr std::optional<TokenKind> lookup(std::string_view spelling) const {
+    const Keyword &slot = slots[getSlot(spelling, seed)];
+    if (slot.spelling != spelling)
+      return std::nullopt;
+    return slot.kind;
+  }
+};
+
+// 'main' is not a keyword, it is declared like any other function.
+constexpr Keyword keywordList[] = {{"fn", TokenKind::KwFunction},
+                                   {"if", TokenKind::KwIf},
+                                   {"else", TokenKind::KwElse},
+                                   {"while", TokenKind::KwWhile},
+                                   {"let", TokenKind::KwLet},
+                                   {"var", TokenKind::KwVar},
+                                   {"return", TokenKind::KwReturn},
+                                   {"add", TokenKind::KwAdd},
+                                   {"print", TokenKind::KwPrint},
+                                   {"log", TokenKind::KwLog}};
+
+constexpr KeywordTable keywords{keywordList};
 
 struct Token {
   SourceLocation location;
   TokenKind kind;
-  std::optional<std::string> value = std::nullopt;
+  // Identifier and number spellings point into the source buffer.
+  std::optional<std::string_view> value = std::nullopt;
 };
 
 class Lexer {
   const SourceFile *source;
   size_t idx = 0;
+  size_t endIdx = 0;
+  size_t tokenStart = 0;
 
-  int line = 1;
-  int column = 0;
-
-  char peekNextChar() const { return source->buffer[idx]; }
+  // Reading one past the end yields the NUL sentinel of the source buffer.
+  char peekNextChar() const { return source->buffer.data()[idx]; }
   char eatNextChar() {
     assert(idx <= source->buffer.size() &&
            "indexing past the end of the source buffer");
-
-    ++column;
-
-    if (source->buffer[idx] == '\n') {
-      ++line;
-      column = 0;
-    }
-
-    return source->buffer[idx++];
+    return source->buffer.data()[idx++];
   }
 
-  bool isAtEnd() const { return idx >= source->buffer.size(); }
+  bool isAtEnd() const { return idx >= endIdx; }
 
-  Token makeToken(TokenKind kind, std::optional<std::string> value = std::nullopt) {
-    return { {source->path, line, column}, kind, std::move(value) };
-  }
+  using ScanFn = const char *(*)(const char *, const char *);
+
+  // Skips the bytes accepted by 'Matcher', using 'scan', one of the vector
+  // kernels picked for the host CPU, for long runs.
+  template <typename Matcher> void skipRun(ScanFn scan);
 
 public:
   explicit Lexer(const SourceFile &source)
-      : source(&source) {}
+      : Lexer(source, 0, source.buffer.size()) {}
+
+  // Lexes only [begin, end) of the buffer and returns Eof at 'end'. Unless
+  // 'end' is the end of the buffer, it must directly follow a newline, so
+  // that no token or comment continues past it.
+  Lexer(const SourceFile &source, size_t begin, size_t end)
+      : source(&source),
+        idx(begin),
+        endIdx(end) {}
+
   Token getNextToken();
+
+  // Offset of the first byte of the token returned last.
+  size_t getTokenStart() const { return tokenStart; }
+  // Offset one past the last byte of the token returned last.
+  size_t getTokenEnd() const { return std::min(idx, endIdx); }
 };
 
-Token Lexer::getNextToken() {
-  while (!isAtEnd() && std::isspace(peekNextChar())) {
-    eatNextChar();
-  }
+// Every token of a source file, lexed up front and stored as parallel arrays
+// of kinds, offsets and lengths. That is 9 bytes per token instead of a full
+// Token, and lets the parser look ahead any number of tokens by index. The
+// last token is always Eof.
+class TokenStream {
+  const SourceFile *source;
+  std::vector<TokenKind> kinds;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> lengths;
 
-  if (isAtEnd()) {
-    return makeToken(TokenKind::Eof);
-  }
+  explicit TokenStream(const SourceFile &source)
+      : source(&source) {}
 
-  char currentChar = eatNextChar();
-  
-  // Handle single character tokens
-  for (char tokenChar : singleCharTokens) {
-    if (currentChar == tokenChar) {
-      return makeToken(static_cast<TokenKind>(currentChar));
-    }
-  }
+  // Appends the tokens of [begin, end), including the Eof at the end.
+  void lexRange(size_t begin, size_t end);
 
-  // Handle identifiers and keywords
-  if (std::isalpha(currentChar)) {
-    std::string identifier(1, currentChar);
-    while (!isAtEnd() && std::isalnum(peekNextChar())) {
-      identifier += eatNextChar();
-    }
-    auto keyword = keywords.find(identifier);
-    if (keyword != keywords.end()) {
-      return makeToken(keyword->second, identifier);
-    }
-    return makeToken(TokenKind::Identifier, identifier);
-  }
+public:
+  // Files large enough to be worth it are split at line boundaries and the
+  // pieces are lexed on up to 'threads' threads. The result is identical to
+  // lexing the whole file on one thread.
+  static TokenStream lex(const SourceFile &source, unsigned threads = 1);
 
-  // Handle numbers
-  if (std::isdigit(currentChar)) {
-    std::string number(1, currentChar);
-    while (!isAtEnd() && std::isdigit(peekNextChar())) {
-      number += eatNextChar();
-    }
-    return makeToken(TokenKind::Number, number);
-  }
+  size_t size() const { return kinds.size(); }
 
-  return makeToken(TokenKind::Unk);
-}
+  // Indices past the end refer to the trailing Eof token.
+  TokenKind getKind(size_t i) const {
+    return kinds[std::min(i, kinds.size() - 1)];
+  }
+  std::string_view getSpelling(size_t i) const;
+  SourceLocation getLocation(size_t i) const;
+  Token getToken(size_t i) const;
+};
 
 } // namespace syscall
 
@@ -1,8 +1,10 @@
 #ifndef SYSCALL_PARSER_H
 #define SYSCALL_PARSER_H
 
+#include <cassert>
 #include <memory>
 #include <optional>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -12,11 +14,25 @@
 namespace syscall {
 
 class Parser {
-  Lexer *lexer;
+  ASTContext *astContext;
+  Lexer *lexer = nullptr;
+  const TokenStream *tokens = nullptr;
+  size_t tokenIdx = 0;
   Token nextToken;
   bool incompleteAST = false;
+  bool skipFunctionBodies = false;
+
+  void eatNextToken() {
+    nextToken = tokens ? tokens->getToken(++tokenIdx) : lexer->getNextToken();
+  }
+
+  // Looks 'n' tokens past nextToken. Only available when parsing a
+  // pre-lexed TokenStream.
+  TokenKind peekTokenKind(size_t n) const {
+    assert(tokens && "lookahead requires a token stream");
+    return tokens->getKind(tokenIdx + n);
+  }
 
-  void eatNextToken() { nextToken = lexer->getNextToken(); }
   void synchronize();
   void synchronizeOn(TokenKind kind) {
     incompleteAST = true;
@@ -26,139 +42,57 @@ class Parser {
   }
 
   // AST node parser methods
-  std::unique_ptr<FunctionDecl> parseFunctionDecl();
-  std::unique_ptr<ParamDecl> parseParamDecl();
-  std::unique_ptr<VarDecl> parseVarDecl(bool isLet);
+  ASTPtr<FunctionDecl> parseFunctionDecl();
+  ASTPtr<ParamDecl> parseParamDecl();
+  ASTPtr<VarDecl> parseVarDecl(bool isLet);
 
-  std::unique_ptr<Stmt> parseStmt();
-  std::unique_ptr<IfStmt> parseIfStmt();
-  std::unique_ptr<WhileStmt> parseWhileStmt();
-  std::unique_ptr<Assignment> parseAssignmentRHS(std::unique_ptr<DeclRefExpr> lhs);
-  std::unique_ptr<DeclStmt> parseDeclStmt();
-  std::unique_ptr<ReturnStmt> parseReturnStmt();
+  ASTPtr<Stmt> parseStmt();
+  ASTPtr<IfStmt> parseIfStmt();
+  ASTPtr<WhileStmt> parseWhileStmt();
+  ASTPtr<Assignment> parseAssignmentRHS(ASTPtr<DeclRefExpr> lhs);
+  ASTPtr<DeclStmt> parseDeclStmt();
+  ASTPtr<ReturnStmt> parseReturnStmt();
 
-  std::unique_ptr<Stmt> parseAssignmentOrExpr();
+  ASTPtr<Stmt> parseAssignmentOrExpr();
 
-  std::unique_ptr<Block> parseBlock();
+  ASTPtr<Block> parseBlock();
+  bool skipBlock();
 
-  std::unique_ptr<Expr> parseExpr();
-  std::unique_ptr<Expr> parseExprRHS(std::unique_ptr<Expr> lhs, int precedence);
-  std::unique_ptr<Expr> parsePrefixExpr();
-  std::unique_ptr<Expr> parsePostfixExpr();
-  std::unique_ptr<Expr> parsePrimary();
+  ASTPtr<Expr> parseExpr();
+  ASTPtr<Expr> parseExprRHS(ASTPtr<Expr> lhs, int precedence);
+  ASTPtr<Expr> parsePrefixExpr();
+  ASTPtr<Expr> parsePostfixExpr();
+  ASTPtr<Expr> parsePrimary();
 
   // helper methods
-  using ParameterList = std::vector<std::unique_ptr<ParamDecl>>;
+  using ParameterList = std::vector<ASTPtr<ParamDecl>>;
   std::unique_ptr<ParameterList> parseParameterList();
 
-  using ArgumentList = std::vector<std::unique_ptr<Expr>>;
+  using ArgumentList = std::vector<ASTPtr<Expr>>;
   std::unique_ptr<ArgumentList> parseArgumentList();
 
   std::optional<Type> parseType();
 
 public:
-  explicit Parser(Lexer &lexer)
-      : lexer(&lexer),
+  Parser(Lexer &lexer, ASTContext &astContext)
+      : astContext(&astContext),
+        lexer(&lexer),
         nextToken(lexer.getNextToken()) {}
+  Parser(const TokenStream &tokens, ASTContext &astContext)
+      : astContext(&astContext),
+        tokens(&tokens),
+        nextToken(tokens.getToken(0)) {}
 
-  std::pair<std::vector<std::unique_ptr<FunctionDecl>>, bool> parseSourceFile();
-};
-
-// Implementation of the Parser methods
-
-void Parser::synchronize() {
-  // Implement synchronization logic here if needed
-}
-
-std::pair<std::vector<std::unique_ptr<FunctionDecl>>, bool> Parser::parseSourceFile() {
-  std::vector<std::unique_ptr<FunctionDecl>> functions;
-
-  while (nextToken.kind != TokenKind::Eof) {
-    if (nextToken.kind == TokenKind::KwMain) {
-      auto function = parseFunctionDecl();
-      if (function) {
-        functions.push_back(std::move(function));
-      }
-    } else {
-      synchronizeOn(TokenKind::KwMain);
-    }
-  }
-
-  return {std::move(functions), incompleteAST};
-}
-
-std::unique_ptr<FunctionDecl> Parser::parseFunctionDecl() {
-  if (nextToken.kind != TokenKind::KwMain) {
-    return nullptr;
-  }
-
-  eatNextToken(); // consume 'main'
+  // Function bodies are only checked for balanced braces and left out of the
+  // tree, which is enough to collect the signatures of a file.
+  void setSkipFunctionBodies(bool skip) { skipFunctionBodies = skip; }
 
-  auto block = parseBlock();
-  return std::make_unique<FunctionDecl>("main", std::move(block));
-}
+  std::pair<std::vector<ASTPtr<FunctionDecl>>, bool> parseSourceFile();
 
-std::unique_ptr<Block> Parser::parseBlock() {
-  auto block = std::make_unique<Block>();
-  
-  while (nextToken.kind != TokenKind::Eof && nextToken.kind != TokenKind::Rbrace) {
-    auto stmt = parseStmt();
-    if (stmt) {
-      block->stmts.push_back(std::move(stmt));
-    }
-  }
-
-  if (nextToken.kind == TokenKind::Rbrace) {
-    eatNextToken(); // consume '}'
-  }
-
-  return block;
-}
-
-std::unique_ptr<Stmt> Parser::parseStmt() {
-  switch (nextToken.kind) {
-    case TokenKind::KwAdd:
-    case TokenKind::KwPrint:
-    case TokenKind::KwLog:
-      return parseAssignmentOrExpr();
-    case TokenKind::KwReturn:
-      return parseReturnStmt();
-    default:
-      return nullptr;
-  }
-}
-
-std::unique_ptr<Stmt> Parser::parseAssignmentOrExpr() {
-  auto lhs = parsePrimary();
-  if (!lhs) return nullptr;
-
-  if (nextToken.kind == TokenKind::EqualSign) {
-    eatNextToken();
-    auto rhs = parseExpr();
-    return std::make_unique<Assignment>(std::move(lhs), std::move(rhs));
-  }
-
-  return nullptr;
-}
-
-std::unique_ptr<ReturnStmt> Parser::parseReturnStmt() {
-  eatNextToken(); // consume 'return'
-  auto expr = parseExpr();
-  return std::make_unique<ReturnStmt>(std::move(expr));
-}
-
-std::unique_ptr<Expr> Parser::parseExpr() {
-  return parsePrimary(); // Simplified for demonstration
-}
-
-std::unique_ptr<Expr> Parser::parsePrimary() {
-  if (nextToken.kind == TokenKind::Number) {
-    auto value = nextToken.value;
-    eatNextToken();
-    return std::make_unique<LiteralExpr>(std::stoi(*value));
-  }
-  return nullptr;
-}
+  // Parses the function at the current position into 'context'. Returns
+  // nullptr if it has syntax errors, which are reported.
+  ASTPtr<FunctionDecl> parseFunctionDecl(ASTContext &context);
+};
 
 } // namespace syscall
 
@@ -1,77 +1,124 @@
 #ifndef SYSCALL_SEMA_H
 #define SYSCALL_SEMA_H
 
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/ScopedHashTable.h>
+
 #include <memory>
 #include <optional>
 #include <vector>
 
 #include "ast.h"
+#include "ast_visitor.h"
 #include "cfg.h"
 #include "constexpr.h"
 
 namespace syscall {
 
-class Sema {
+// Resolves the parsed tree in place: every expression gets its type, every
+// name the declaration it refers to, and conditions and initializers their
+// constant value if they have one. The nodes are returned for codegen as they
+// are, so no second tree is allocated.
+class Sema : public MutableASTVisitor<Sema, Expr *> {
+  friend MutableASTVisitor<Sema, Expr *>;
+
+  ASTContext *astContext;
   ConstantExpressionEvaluator cee;
-  std::vector<std::unique_ptr<SyscallFunctionDecl>> ast;
-  std::vector<std::vector<SyscallDecl *>> scopes;
+  std::vector<ASTPtr<FunctionDecl>> ast;
+
+  // Set on the workers that resolve bodies in parallel. Names that aren't
+  // declared in the body are looked up in the global scope of the parent,
+  // which is only read while the workers run.
+  const Sema *parent = nullptr;
+
+  // Maps every visible name to its innermost declaration and the depth of
+  // the scope that declared it. Leaving a scope pops the entries it inserted,
+  // so lookups don't depend on the number of enclosing declarations.
+  using SymbolTable =
+      llvm::ScopedHashTable<Symbol, std::pair<Decl *, unsigned>>;
+  SymbolTable symbolTable;
+  unsigned scopeDepth = 0;
 
-  SyscallResolvedFunctionDecl *currentFunction;
+  FunctionDecl *currentFunction;
 
   class ScopeRAII {
     Sema *sema;
+    SymbolTable::ScopeTy scope;
 
   public:
     explicit ScopeRAII(Sema *sema)
-        : sema(sema) {
-      sema->scopes.emplace_back();
+        : sema(sema),
+          scope(sema->symbolTable) {
+      ++sema->scopeDepth;
     }
-    ~ScopeRAII() { sema->scopes.pop_back(); }
+    ~ScopeRAII() { --sema->scopeDepth; }
   };
 
-  std::optional<SyscallType> resolveType(SyscallType parsedType);
-
-  std::unique_ptr<SyscallResolvedUnaryOperator>
-  resolveUnaryOperator(const SyscallUnaryOperator &unary);
-  std::unique_ptr<SyscallResolvedBinaryOperator>
-  resolveBinaryOperator(const SyscallBinaryOperator &binop);
-  std::unique_ptr<SyscallResolvedGroupingExpr>
-  resolveGroupingExpr(const SyscallGroupingExpr &grouping);
-  std::unique_ptr<SyscallResolvedDeclRefExpr>
-  resolveDeclRefExpr(const SyscallDeclRefExpr &declRefExpr, bool isCallee = false);
-  std::unique_ptr<SyscallResolvedCallExpr> resolveCallExpr(const SyscallCallExpr &call);
-  std::unique_ptr<SyscallResolvedExpr> resolveExpr(const SyscallExpr &expr);
-
-  std::unique_ptr<SyscallResolvedStmt> resolveStmt(const SyscallStmt &stmt);
-  std::unique_ptr<SyscallResolvedIfStmt> resolveIfStmt(const SyscallIfStmt &ifStmt);
-  std::unique_ptr<SyscallResolvedWhileStmt>
-  resolveWhileStmt(const SyscallWhileStmt &whileStmt);
-  std::unique_ptr<SyscallResolvedDeclStmt> resolveDeclStmt(const SyscallDeclStmt &declStmt);
-  std::unique_ptr<SyscallResolvedAssignment>
-  resolveAssignment(const SyscallAssignment &assignment);
-  std::unique_ptr<SyscallResolvedReturnStmt>
-  resolveReturnStmt(const SyscallReturnStmt &returnStmt);
-
-  std::unique_ptr<SyscallResolvedBlock> resolveBlock(const SyscallBlock &block);
-
-  std::unique_ptr<SyscallResolvedParamDecl> resolveParamDecl(const SyscallParamDecl &param);
-  std::unique_ptr<SyscallResolvedVarDecl> resolveVarDecl(const SyscallVarDecl &varDecl);
-  std::unique_ptr<SyscallResolvedFunctionDecl>
-  resolveFunctionDeclaration(const SyscallFunctionDecl &function);
-
-  bool insertDeclToCurrentScope(SyscallResolvedDecl &decl);
-  std::pair<SyscallResolvedDecl *, int> lookupDecl(const std::string id);
-  std::unique_ptr<SyscallResolvedFunctionDecl> createBuiltinPrintln();
-
-  bool runFlowSensitiveChecks(const SyscallResolvedFunctionDecl &fn);
-  bool checkReturnOnAllPaths(const SyscallResolvedFunctionDecl &fn, const CFG &cfg);
+  // The functions stay visible to every body resolved after them.
+  std::optional<ScopeRAII> globalScope;
+
+  std::optional<Type> resolveType(Type parsedType);
+
+  // Each of these returns the node it resolved, or nullptr on error.
+  NumberLiteral *visitNumberLiteral(NumberLiteral &number);
+  UnaryOperator *visitUnaryOperator(UnaryOperator &unary);
+  BinaryOperator *visitBinaryOperator(BinaryOperator &binop);
+  GroupingExpr *visitGroupingExpr(GroupingExpr &grouping);
+  DeclRefExpr *visitDeclRefExpr(DeclRefExpr &declRefExpr);
+  CallExpr *visitCallExpr(CallExpr &call);
+
+  DeclRefExpr *resolveDeclRefExpr(DeclRefExpr &declRefExpr,
+                                  bool isCallee = false);
+  Expr *resolveExpr(Expr &expr);
+
+  Stmt *resolveStmt(Stmt &stmt);
+  IfStmt *resolveIfStmt(IfStmt &ifStmt);
+  WhileStmt *resolveWhileStmt(WhileStmt &whileStmt);
+  DeclStmt *resolveDeclStmt(DeclStmt &declStmt);
+  Assignment *resolveAssignment(Assignment &assignment);
+  ReturnStmt *resolveReturnStmt(ReturnStmt &returnStmt);
+
+  Block *resolveBlock(Block &block);
+
+  ParamDecl *resolveParamDecl(ParamDecl &param);
+  VarDecl *resolveVarDecl(VarDecl &varDecl);
+  FunctionDecl *resolveFunctionDeclaration(FunctionDecl &function);
+
+  bool resolveFunctionBodies(llvm::ArrayRef<ASTPtr<FunctionDecl>> functions,
+                             unsigned threadCount);
+
+  bool insertDeclToCurrentScope(Decl &decl);
+  std::pair<Decl *, int> lookupDecl(Symbol id);
+  ASTPtr<FunctionDecl> createBuiltinPrintln();
+
+  bool runFlowSensitiveChecks(const FunctionDecl &fn);
+  bool checkReturnOnAllPaths(const FunctionDecl &fn, const CFG &cfg);
   bool checkVariableInitialization(const CFG &cfg);
 
-public:
-  explicit Sema(std::vector<std::unique_ptr<SyscallFunctionDecl>> ast)
-      : ast(std::move(ast)) {}
+  explicit Sema(const Sema *parent)
+      : astContext(parent->astContext),
+        parent(parent),
+        scopeDepth(parent->scopeDepth) {}
 
-  std::vector<std::unique_ptr<SyscallResolvedFunctionDecl>> resolveAST();
+public:
+  // The builtins are allocated in 'astContext' too.
+  Sema(ASTContext &astContext, std::vector<ASTPtr<FunctionDecl>> ast)
+      : astContext(&astContext),
+        ast(std::move(ast)) {}
+
+  // Returns the resolved tree, which starts with the builtin functions, or
+  // an empty tree if there was an error. The bodies are resolved on up to
+  // 'threadCount' threads, and their diagnostics are printed in source order.
+  std::vector<ASTPtr<FunctionDecl>> resolveAST(unsigned threadCount = 1);
+
+  // The two halves of resolveAST, for callers that don't keep every body in
+  // memory. The signatures are resolved first, then each body on its own,
+  // once it has been attached to its function.
+  bool resolveFunctionDeclarations();
+  bool resolveFunctionBody(FunctionDecl &fn);
+
+  // The functions being resolved, starting with the builtins.
+  llvm::ArrayRef<ASTPtr<FunctionDecl>> getFunctions() const { return ast; }
 };
 
 } // namespace syscall
@@ -0,0 +1,30 @@
+#ifndef SYSCALL_SERVER_H
+#define SYSCALL_SERVER_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/STLFunctionalExtras.h>
+
+#include <optional>
+#include <string>
+
+namespace syscall {
+
+// Compiles with the forwarded arguments and returns the exit code.
+using CompileFn = llvm::function_ref<int(int argc, const char **argv)>;
+
+// Listens on a Unix domain socket and serves compile requests until the
+// process is killed. Every request is handled in a child forked from the
+// server, so it starts with the already initialized LLVM state, runs in the
+// client's working directory and writes diagnostics to the client's stdout
+// and stderr.
+int runCompileServer(const std::string &socketPath, CompileFn compile);
+
+// Forwards the arguments to the server listening on 'socketPath' and returns
+// the exit code of the compilation, or std::nullopt if no server could be
+// reached.
+std::optional<int> forwardToCompileServer(const std::string &socketPath,
+                                          llvm::ArrayRef<std::string> args);
+
+} // namespace syscall
+
+#endif // SYSCALL_SERVER_H
@@ -0,0 +1,76 @@
+#ifndef SYSCALL_SOURCE_MANAGER_H
+#define SYSCALL_SOURCE_MANAGER_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace syscall {
+
+// A position in one of the files registered with the SourceManager. Files are
+// laid out in a single 32-bit offset space, so the offset alone identifies
+// both the file and the byte within it. Offset 0 is reserved for
+// locations that don't belong to any file, like those of builtins.
+struct SourceLocation {
+  uint32_t offset = 0;
+
+  bool isValid() const { return offset != 0; }
+};
+
+// A SourceLocation decoded into a human readable position. The path is a
+// copy, so it stays valid after the file is removed.
+struct PresumedLocation {
+  std::string filepath;
+  int line;
+  int col;
+};
+
+// Owns the mapping from SourceLocations back to files, lines and columns.
+// Line and column numbers are only needed for diagnostics, so the newline
+// table of a file is built the first time one of its locations is decoded.
+class SourceManager {
+  struct FileEntry {
+    std::string path;
+    std::string_view buffer;
+    uint32_t startOffset;
+
+    // Empty until the first location of the file is decoded.
+    mutable std::vector<uint32_t> lineStarts;
+  };
+
+  mutable std::mutex mutex;
+  // Sorted by offset. Removed files leave gaps that later files can reuse.
+  std::vector<std::unique_ptr<FileEntry>> files;
+
+  SourceManager() = default;
+
+  // Returns the file 'location' points into, or nullptr if it points into a
+  // gap, like the locations of a removed file. 'mutex' has to be held.
+  const FileEntry *getFileEntry(SourceLocation location) const;
+
+public:
+  static SourceManager &get();
+
+  // Reserves locations for every byte of 'buffer' and one past its end.
+  // Returns the offset of the first byte, or nullopt if the files that are
+  // registered at the same time don't fit into the 32-bit offset space.
+  // 'buffer' must outlive every lookup of its locations.
+  std::optional<uint32_t> addFile(std::string_view path,
+                                  std::string_view buffer);
+
+  // Releases the locations of the file starting at 'startOffset', which
+  // must no longer be looked up.
+  void removeFile(uint32_t startOffset);
+
+  // Locations that don't point into a registered file, because they belong
+  // to a builtin or to a file that was removed since, decode as "<builtin>".
+  PresumedLocation getPresumedLocation(SourceLocation location) const;
+};
+
+} // namespace syscall
+
+#endif // SYSCALL_SOURCE_MANAGER_H
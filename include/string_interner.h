@@ -0,0 +1,80 @@
+#ifndef SYSCALL_STRING_INTERNER_H
+#define SYSCALL_STRING_INTERNER_H
+
+#include <llvm/ADT/DenseMapInfo.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/Allocator.h>
+
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace syscall {
+// A handle to a name interned in a StringInterner. Every spelling is stored
+// once per interner, so two symbols of the same interner are equal if and
+// only if they point to the same entry, and comparing them is a pointer
+// compare.
+class Symbol {
+  friend class StringInterner;
+  friend struct llvm::DenseMapInfo<Symbol>;
+
+  const llvm::StringMapEntry<llvm::NoneType> *entry = nullptr;
+
+  explicit Symbol(const llvm::StringMapEntry<llvm::NoneType> *entry)
+      : entry(entry) {}
+
+public:
+  Symbol() = default;
+
+  bool isValid() const { return entry; }
+
+  llvm::StringRef getName() const { return entry->getKey(); }
+  std::string str() const { return getName().str(); }
+
+  friend bool operator==(Symbol lhs, Symbol rhs) {
+    return lhs.entry == rhs.entry;
+  }
+  friend bool operator!=(Symbol lhs, Symbol rhs) {
+    return lhs.entry != rhs.entry;
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, Symbol symbol) {
+    llvm::StringRef name = symbol.getName();
+    return os.write(name.data(), name.size());
+  }
+};
+
+// Owns the spellings of the names of a compilation. The entries are never
+// moved, so the symbols stay valid for the lifetime of the interner. Interning
+// isn't thread-safe.
+class StringInterner {
+  llvm::StringSet<llvm::BumpPtrAllocator> table;
+
+public:
+  Symbol intern(std::string_view name) {
+    return Symbol(&*table.insert(llvm::StringRef(name)).first);
+  }
+};
+} // namespace syscall
+
+namespace llvm {
+// Lets symbols be used as keys of DenseMap and ScopedHashTable.
+template <> struct DenseMapInfo<syscall::Symbol> {
+  using EntryInfo = DenseMapInfo<const StringMapEntry<NoneType> *>;
+
+  static syscall::Symbol getEmptyKey() {
+    return syscall::Symbol(EntryInfo::getEmptyKey());
+  }
+  static syscall::Symbol getTombstoneKey() {
+    return syscall::Symbol(EntryInfo::getTombstoneKey());
+  }
+  static unsigned getHashValue(syscall::Symbol symbol) {
+    return EntryInfo::getHashValue(symbol.entry);
+  }
+  static bool isEqual(syscall::Symbol lhs, syscall::Symbol rhs) {
+    return lhs == rhs;
+  }
+};
+} // namespace llvm
+
+#endif // SYSCALL_STRING_INTERNER_H
@@ -0,0 +1,119 @@
+#ifndef SYSCALL_TIMER_H
+#define SYSCALL_TIMER_H
+
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace syscall {
+
+// Collects wall, user and system time and the resident set size high-water
+// mark for every compiler phase. Samples of the same phase are accumulated,
+// so a phase that runs once per function or per source file shows up as a
+// single row. Phases can run on several threads at once: their user and
+// system time is the sum of the CPU time of those threads, while their wall
+// time only counts the time during which at least one thread was in them.
+// The helper threads a phase starts, like those of parallel lexing, don't
+// enter it, so their CPU time only shows up in the total.
+class TimingReport {
+  using Clock = std::chrono::steady_clock;
+
+  struct Phase {
+    std::string name;
+    int depth = 0;
+    double wall = 0;
+    double user = 0;
+    double system = 0;
+    long peakRSS = 0;
+
+    // The threads currently in the phase, and since when there are any.
+    int activeThreads = 0;
+    Clock::time_point activeSince;
+  };
+
+  mutable std::mutex mutex;
+  std::vector<Phase> phases;
+  bool enabled = false;
+
+  // When the report was enabled, to measure the whole compilation.
+  Clock::time_point startWall;
+  double startUser = 0;
+  double startSystem = 0;
+
+  TimingReport() = default;
+
+public:
+  static TimingReport &get();
+
+  void enable();
+  bool isEnabled() const { return enabled; }
+
+  // Marks the start of a sample of the phase on the calling thread, and
+  // returns the phase to pass to endSample.
+  size_t beginSample(std::string_view name, int depth);
+  void endSample(size_t phase, double user, double system);
+
+  void print(llvm::raw_ostream &os) const;
+};
+
+// Measures the enclosing scope as one sample of the given phase. Scopes can
+// be nested, in which case the inner phase is indented in the report. The
+// phase is also recorded as a span in the time trace, if one is requested.
+class PhaseTimerRAII {
+  llvm::TimeTraceScope traceScope;
+  size_t phase = 0;
+  bool active;
+  double user = 0;
+  double system = 0;
+
+public:
+  explicit PhaseTimerRAII(std::string_view name);
+  ~PhaseTimerRAII();
+
+  PhaseTimerRAII(const PhaseTimerRAII &) = delete;
+  PhaseTimerRAII &operator=(const PhaseTimerRAII &) = delete;
+};
+
+// The nesting depth of the phases is tracked per thread, so a phase that a
+// worker thread enters would be reported at the top level, next to the phase
+// that started the worker. The spawning thread passes the depth it is at to
+// the worker, which keeps it until the end of the scope.
+int getPhaseNestingDepth();
+
+class PhaseNestingRAII {
+  int savedDepth;
+
+public:
+  explicit PhaseNestingRAII(int depth);
+  ~PhaseNestingRAII();
+
+  PhaseNestingRAII(const PhaseNestingRAII &) = delete;
+  PhaseNestingRAII &operator=(const PhaseNestingRAII &) = delete;
+};
+
+// Starts recording the time trace of the process, with spans shorter than
+// 'granularity' microseconds left out.
+void initializeTimeTrace(unsigned granularity, llvm::StringRef processName);
+
+// LLVM keeps a time trace profiler per thread, so the spans of a worker thread
+// are lost unless it has one. Records the spans of the current thread until
+// the end of the scope, if the time trace of the process is being recorded.
+class TimeTraceThreadRAII {
+  bool active;
+
+public:
+  explicit TimeTraceThreadRAII(llvm::StringRef threadName);
+  ~TimeTraceThreadRAII();
+
+  TimeTraceThreadRAII(const TimeTraceThreadRAII &) = delete;
+  TimeTraceThreadRAII &operator=(const TimeTraceThreadRAII &) = delete;
+};
+
+} // namespace syscall
+
+#endif // SYSCALL_TIMER_H
@@ -6,34 +6,90 @@
   if (!var)                                                                    \
     return nullptr;
 
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <iostream>
 
+#include "source_manager.h"
+
 namespace syscall {
 
+// The contents of a source file are borrowed from 'storage', which for large
+// files is a read-only mapping of the file itself. The byte right after the
+// end of 'buffer' is always a NUL sentinel, so the lexer can stop on '\0'
+// without bounds checks. The locations of the file are released when it is
+// destroyed, so that long-running processes don't exhaust the SourceManager.
 struct SourceFile {
   std::string_view path;
-  std::string buffer;
-};
+  std::string_view buffer;
+  std::unique_ptr<llvm::MemoryBuffer> storage;
+  // Location of the first byte of 'buffer' in the SourceManager.
+  uint32_t startOffset;
 
-struct SourceLocation {
-  std::string_view filepath;
-  int line;
-  int col;
+  SourceFile(std::string_view path,
+             std::unique_ptr<llvm::MemoryBuffer> storage,
+             uint32_t startOffset)
+      : path(path),
+        buffer(storage->getBuffer()),
+        storage(std::move(storage)),
+        startOffset(startOffset) {}
+  SourceFile(SourceFile &&) = default;
+  SourceFile &operator=(SourceFile &&other) {
+    std::swap(path, other.path);
+    std::swap(buffer, other.buffer);
+    std::swap(storage, other.storage);
+    std::swap(startOffset, other.startOffset);
+    return *this;
+  }
+  ~SourceFile() {
+    if (storage)
+      SourceManager::get().removeFile(startOffset);
+  }
+
+  static llvm::Expected<SourceFile> open(std::string_view path) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> file =
+        llvm::MemoryBuffer::getFile(llvm::StringRef(path), /*IsText=*/false,
+                                    /*RequiresNullTerminator=*/true);
+    if (!file)
+      return llvm::errorCodeToError(file.getError());
+
+    std::optional<uint32_t> startOffset =
+        SourceManager::get().addFile(path, (*file)->getBuffer());
+    if (!startOffset)
+      return llvm::createStringError(
+          llvm::inconvertibleErrorCode(),
+          "the open source files exceed the 4 GiB of source locations");
+
+    return SourceFile(path, std::move(*file), *startOffset);
+  }
+
+  SourceLocation getLocation(size_t offset) const {
+    return SourceLocation{static_cast<uint32_t>(startOffset + offset)};
+  }
 };
 
 std::nullptr_t report(SourceLocation location,
                       std::string_view message,
-                      bool isWarning = false) {
-  if (isWarning) {
-    std::cerr << "Warning: ";
-  } else {
-    std::cerr << "Error: ";
-  }
-  std::cerr << location.filepath << ":" << location.line << ":" << location.col << " - " << message << std::endl;
-  return nullptr;
-}
+                      bool isWarning = false);
+
+// Collects the diagnostics reported on the current thread into 'buffer'
+// instead of printing them, until the end of the scope.
+class DiagnosticBufferRAII {
+  std::string *previousBuffer;
+
+public:
+  explicit DiagnosticBufferRAII(std::string &buffer);
+  ~DiagnosticBufferRAII();
+
+  DiagnosticBufferRAII(const DiagnosticBufferRAII &) = delete;
+  DiagnosticBufferRAII &operator=(const DiagnosticBufferRAII &) = delete;
+};
 
 template <typename Ty> class ConstantValueContainer {
   std::optional<Ty> value = std::nullopt;
@@ -29,189 +29,130 @@ std::string_view getOpStr(TokenKind op) {
 }
 
 std::string indent(size_t level) { return std::string(level * 2, ' '); }
+
+void dumpConstantValue(const Expr &expr, size_t level) {
+  if (auto val = expr.getConstantValue())
+    std::cerr << indent(level) << "| value: " << *val << '\n';
+}
 } // namespace
 
-void SyscallBlock::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallBlock\n";
+void Block::dump(size_t level) const {
+  std::cerr << indent(level) << "Block\n";
   for (auto &&stmt : statements)
     stmt->dump(level + 1);
 }
 
-void SyscallIfStmt::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallIfStmt\n";
+void IfStmt::dump(size_t level) const {
+  std::cerr << indent(level) << "IfStmt\n";
   condition->dump(level + 1);
   trueBlock->dump(level + 1);
   if (falseBlock)
     falseBlock->dump(level + 1);
 }
 
-void SyscallWhileStmt::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallWhileStmt\n";
+void WhileStmt::dump(size_t level) const {
+  std::cerr << indent(level) << "WhileStmt\n";
   condition->dump(level + 1);
   body->dump(level + 1);
 }
 
-void SyscallReturnStmt::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallReturnStmt\n";
+void ReturnStmt::dump(size_t level) const {
+  std::cerr << indent(level) << "ReturnStmt\n";
   if (expr)
     expr->dump(level + 1);
 }
 
-void SyscallNumberLiteral::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallNumberLiteral: '" << value << "'\n";
+void BreakStmt::dump(size_t level) const {
+  std::cerr << indent(level) << "BreakStmt\n";
+}
+
+void ContinueStmt::dump(size_t level) const {
+  std::cerr << indent(level) << "ContinueStmt\n";
 }
 
-void SyscallDeclRefExpr::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallDeclRefExpr: " << identifier << '\n';
+void NumberLiteral::dump(size_t level) const {
+  std::cerr << indent(level) << "NumberLiteral: '" << value << "'\n";
+  dumpConstantValue(*this, level);
 }
 
-void SyscallCallExpr::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallCallExpr:\n";
+void DeclRefExpr::dump(size_t level) const {
+  std::cerr << indent(level) << "DeclRefExpr: ";
+  if (decl)
+    std::cerr << "@(" << decl << ") ";
+  std::cerr << identifier << '\n';
+  dumpConstantValue(*this, level);
+}
+
+void CallExpr::dump(size_t level) const {
+  std::cerr << indent(level) << "CallExpr:\n";
+  dumpConstantValue(*this, level);
   callee->dump(level + 1);
   for (auto &&arg : arguments)
     arg->dump(level + 1);
 }
 
-void SyscallGroupingExpr::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallGroupingExpr:\n";
+void GroupingExpr::dump(size_t level) const {
+  std::cerr << indent(level) << "GroupingExpr:\n";
+  dumpConstantValue(*this, level);
   expr->dump(level + 1);
 }
 
-void SyscallBinaryOperator::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallBinaryOperator: '" << getOpStr(op) << "'\n";
+void BinaryOperator::dump(size_t level) const {
+  std::cerr << indent(level) << "BinaryOperator: '" << getOpStr(op) << "'\n";
+  dumpConstantValue(*this, level);
   lhs->dump(level + 1);
   rhs->dump(level + 1);
 }
 
-void SyscallUnaryOperator::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallUnaryOperator: '" << getOpStr(op) << "'\n";
+void UnaryOperator::dump(size_t level) const {
+  std::cerr << indent(level) << "UnaryOperator: '" << getOpStr(op) << "'\n";
+  dumpConstantValue(*this, level);
   operand->dump(level + 1);
 }
 
-void SyscallParamDecl::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallParamDecl: " << identifier << ':' << type.name << '\n';
-}
-
-void SyscallVarDecl::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallVarDecl: " << identifier;
-  if (type)
-    std::cerr << ':' << type->name;
-  std::cerr << '\n';
-  if (initializer)
-    initializer->dump(level + 1);
-}
-
-void SyscallFunctionDecl::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallFunctionDecl: " << identifier << ':' << type.name << '\n';
-  for (auto &&param : params)
-    param->dump(level + 1);
-  body->dump(level + 1);
-}
-
-void SyscallDeclStmt::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallDeclStmt:\n";
-  varDecl->dump(level + 1);
+void ReadRegisterExpr::dump(size_t level) const {
+  std::cerr << indent(level) << "ReadRegisterExpr: '" << address << "'\n";
+  dumpConstantValue(*this, level);
 }
 
-void SyscallAssignment::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallAssignment:\n";
-  variable->dump(level + 1);
+void LogExpr::dump(size_t level) const {
+  std::cerr << indent(level) << "LogExpr:\n";
+  dumpConstantValue(*this, level);
   expr->dump(level + 1);
 }
 
-void SyscallResolvedBlock::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedBlock\n";
-  for (auto &&stmt : statements)
-    stmt->dump(level + 1);
-}
-
-void SyscallResolvedIfStmt::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedIfStmt\n";
-  condition->dump(level + 1);
-  trueBlock->dump(level + 1);
-  if (falseBlock)
-    falseBlock->dump(level + 1);
-}
-
-void SyscallResolvedWhileStmt::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedWhileStmt\n";
-  condition->dump(level + 1);
-  body->dump(level + 1);
-}
-
-void SyscallResolvedParamDecl::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedParamDecl: @(" << this << ") " << identifier << ':' << '\n';
+void ParamDecl::dump(size_t level) const {
+  std::cerr << indent(level) << "ParamDecl: @(" << this << ") " << identifier
+            << ':' << type.name << '\n';
 }
 
-void SyscallResolvedVarDecl::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedVarDecl: @(" << this << ") " << identifier << ':' << '\n';
+void VarDecl::dump(size_t level) const {
+  std::cerr << indent(level) << "VarDecl: @(" << this << ") " << identifier;
+  if (type)
+    std::cerr << ':' << type->name;
+  std::cerr << '\n';
   if (initializer)
     initializer->dump(level + 1);
 }
 
-void SyscallResolvedFunctionDecl::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedFunctionDecl: @(" << this << ") " << identifier << ':' << '\n';
+void FunctionDecl::dump(size_t level) const {
+  std::cerr << indent(level) << "FunctionDecl: @(" << this << ") " << identifier
+            << ':' << type.name << '\n';
   for (auto &&param : params)
     param->dump(level + 1);
-  body->dump(level + 1);
-}
-
-void SyscallResolvedNumberLiteral::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedNumberLiteral: '" << value << "'\n";
-  if (auto val = getConstantValue())
-    std::cerr << indent(level) << "| value: " << *val << '\n';
-}
-
-void SyscallResolvedDeclRefExpr::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedDeclRefExpr: @(" << decl << ") " << decl->identifier << '\n';
-  if (auto val = getConstantValue())
-    std::cerr << indent(level) << "| value: " << *val << '\n';
-}
-
-void SyscallResolvedCallExpr::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedCallExpr: @(" << callee << ") " << callee->identifier << '\n';
-  if (auto val = getConstantValue())
-    std::cerr << indent(level) << "| value: " << *val << '\n';
-  for (auto &&arg : arguments)
-    arg->dump(level + 1);
-}
-
-void SyscallResolvedGroupingExpr::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedGroupingExpr:\n";
-  if (auto val = getConstantValue())
-    std::cerr << indent(level) << "| value: " << *val << '\n';
-  expr->dump(level + 1);
+  if (body)
+    body->dump(level + 1);
 }
 
-void SyscallResolvedBinaryOperator::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedBinaryOperator: '" << getOpStr(op) << "'\n";
-  if (auto val = getConstantValue())
-    std::cerr << indent(level) << "| value: " << *val << '\n';
-  lhs->dump(level + 1);
-  rhs->dump(level + 1);
-}
-
-void SyscallResolvedUnaryOperator::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedUnaryOperator: '" << getOpStr(op) << "'\n";
-  if (auto val = getConstantValue())
-    std::cerr << indent(level) << "| value: " << *val << '\n';
-  operand->dump(level + 1);
-}
-
-void SyscallResolvedDeclStmt::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedDeclStmt:\n";
+void DeclStmt::dump(size_t level) const {
+  std::cerr << indent(level) << "DeclStmt:\n";
   varDecl->dump(level + 1);
 }
 
-void SyscallResolvedAssignment::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedAssignment:\n";
+void Assignment::dump(size_t level) const {
+  std::cerr << indent(level) << "Assignment:\n";
   variable->dump(level + 1);
   expr->dump(level + 1);
 }
 
-void SyscallResolvedReturnStmt::dump(size_t level) const {
-  std::cerr << indent(level) << "SyscallResolvedReturnStmt\n";
-  if (expr)
-    expr->dump(level + 1);
-}
 } // namespace syscall
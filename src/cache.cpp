@@ -0,0 +1,166 @@
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/SHA256.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <set>
+
+#include "cache.h"
+
+namespace syscall {
+namespace {
+// Bump this whenever the layout of the cached objects changes.
+constexpr std::string_view cacheFormatVersion = "syscall-cache-v1";
+
+// The size and modification time of the compiler executable change on every
+// rebuild, which is enough to tell two compilers apart without hashing the
+// whole binary on each invocation.
+std::string getCompilerIdentity() {
+  static int anchor;
+  std::string path = llvm::sys::fs::getMainExecutable(nullptr, &anchor);
+
+  llvm::sys::fs::file_status status;
+  if (llvm::sys::fs::status(path, status))
+    return path;
+
+  return path + ':' + std::to_string(status.getSize()) + ':' +
+         std::to_string(status.getLastModificationTime().time_since_epoch().count());
+}
+
+// File locks are owned by the whole process, so threads of the same process
+// that compile identical inputs have to be serialized separately.
+std::mutex lockedKeysMutex;
+std::condition_variable lockedKeysChanged;
+std::set<std::string> lockedKeys;
+} // namespace
+
+CompilationCache::EntryLock::~EntryLock() {
+  if (fd != -1) {
+    // Removed before it is unlocked, so whoever gets the lock next can tell
+    // that it locked a file that is gone, see lock().
+    llvm::sys::fs::remove(lockPath);
+    llvm::sys::fs::unlockFile(fd);
+    llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+  }
+
+  if (key.empty())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(lockedKeysMutex);
+    lockedKeys.erase(key);
+  }
+  lockedKeysChanged.notify_all();
+}
+
+std::filesystem::path
+CompilationCache::getEntryPath(const std::string &key) const {
+  return directory / (key + ".o");
+}
+
+bool CompilationCache::initialize() const {
+  return !llvm::sys::fs::create_directories(directory.string());
+}
+
+std::string CompilationCache::computeKey(std::string_view source,
+                                         llvm::ArrayRef<std::string> flags) {
+  static const std::string compilerIdentity = getCompilerIdentity();
+
+  llvm::SHA256 hasher;
+  hasher.update(cacheFormatVersion);
+  hasher.update(compilerIdentity);
+
+  // Every component is followed by a separator that can't appear in it, so
+  // different splits of the same bytes don't collide.
+  for (auto &&flag : flags) {
+    hasher.update(llvm::StringRef("\0", 1));
+    hasher.update(flag);
+  }
+
+  hasher.update(llvm::StringRef("\0", 1));
+  hasher.update(source);
+
+  return llvm::toHex(hasher.final(), /*LowerCase=*/true);
+}
+
+CompilationCache::EntryLock
+CompilationCache::lock(const std::string &key) const {
+  {
+    std::unique_lock<std::mutex> lock(lockedKeysMutex);
+    lockedKeysChanged.wait(lock, [&] { return !lockedKeys.count(key); });
+    lockedKeys.insert(key);
+  }
+
+  // If the lock file can't be used, the entry is still written atomically,
+  // concurrent processes might just compile the same input twice.
+  std::string lockPath = (directory / (key + ".lock")).string();
+  while (true) {
+    int fd = -1;
+    if (llvm::sys::fs::openFileForWrite(lockPath, fd,
+                                        llvm::sys::fs::CD_OpenAlways))
+      return EntryLock(key, "", -1);
+
+    llvm::sys::fs::file_status lockedStatus;
+    if (llvm::sys::fs::lockFile(fd) ||
+        llvm::sys::fs::status(fd, lockedStatus)) {
+      llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+      return EntryLock(key, "", -1);
+    }
+
+    // The previous holder removes the file before unlocking it. If that
+    // happened after it was opened here, the lock excludes nobody, and a
+    // fresh file has to be locked instead.
+    llvm::sys::fs::file_status currentStatus;
+    if (!llvm::sys::fs::status(lockPath, currentStatus) &&
+        llvm::sys::fs::equivalent(lockedStatus, currentStatus))
+      return EntryLock(key, std::move(lockPath), fd);
+
+    llvm::sys::fs::unlockFile(fd);
+    llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+  }
+}
+
+bool CompilationCache::load(const std::string &key,
+                            llvm::SmallVectorImpl<char> &object) const {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> entry =
+      llvm::MemoryBuffer::getFile(getEntryPath(key).string(),
+                                  /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!entry)
+    return false;
+
+  llvm::StringRef contents = (*entry)->getBuffer();
+  object.assign(contents.begin(), contents.end());
+  return true;
+}
+
+void CompilationCache::store(const std::string &key,
+                             llvm::ArrayRef<char> object) const {
+  // The object is written to a private file first and then renamed into
+  // place, so readers never observe a partially written entry.
+  int fd = -1;
+  llvm::SmallString<128> tmpPath;
+  if (llvm::sys::fs::createUniqueFile((directory / (key + "-%%%%%%.tmp")).string(),
+                                      fd, tmpPath))
+    return;
+
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    os.write(object.data(), object.size());
+    os.close();
+
+    if (os.has_error()) {
+      os.clear_error();
+      llvm::sys::fs::remove(tmpPath);
+      return;
+    }
+  }
+
+  if (llvm::sys::fs::rename(tmpPath, getEntryPath(key).string()))
+    llvm::sys::fs::remove(tmpPath);
+}
+} // namespace syscall
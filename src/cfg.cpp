@@ -1,3 +1,5 @@
+#include <llvm/Support/TimeProfiler.h>
+
 #include <iostream>
 
 #include "ast.h"
@@ -5,12 +7,17 @@
 
 namespace syscall {
 namespace {
-bool isTerminator(const ResolvedStmt &stmt) {
-  return dynamic_cast<const ResolvedIfStmt *>(&stmt) ||
-         dynamic_cast<const ResolvedWhileStmt *>(&stmt) ||
-         dynamic_cast<const ResolvedReturnStmt *>(&stmt) ||
-         dynamic_cast<const ResolvedBreakStmt *>(&stmt) || // Syscall-specific
-         dynamic_cast<const ResolvedContinueStmt *>(&stmt); // Syscall-specific
+bool isTerminator(const Stmt &stmt) {
+  switch (stmt.getKind()) {
+    case Stmt::Kind::IfStmt:
+    case Stmt::Kind::WhileStmt:
+    case Stmt::Kind::ReturnStmt:
+    case Stmt::Kind::BreakStmt:    // Syscall-specific
+    case Stmt::Kind::ContinueStmt: // Syscall-specific
+      return true;
+    default:
+      return false;
+  }
 }
 } // namespace
 
@@ -40,7 +47,7 @@ void CFG::dump() const {
   }
 }
 
-int CFGBuilder::insertIfStmt(const ResolvedIfStmt &stmt, int exit) {
+int CFGBuilder::visitIfStmt(const IfStmt &stmt, int exit) {
   int falseBlock = exit;
   if (stmt.falseBlock)
     falseBlock = insertBlock(*stmt.falseBlock, exit);
@@ -53,10 +60,10 @@ int CFGBuilder::insertIfStmt(const ResolvedIfStmt &stmt, int exit) {
   cfg.insertEdge(entry, falseBlock, val.value_or(0) == 0);
 
   cfg.insertStmt(&stmt, entry);
-  return insertExpr(*stmt.condition, entry);
+  return visit(*stmt.condition, entry);
 }
 
-int CFGBuilder::insertWhileStmt(const ResolvedWhileStmt &stmt, int exit) {
+int CFGBuilder::visitWhileStmt(const WhileStmt &stmt, int exit) {
   int latch = cfg.insertNewBlock();
   int body = insertBlock(*stmt.body, latch);
 
@@ -68,99 +75,78 @@ int CFGBuilder::insertWhileStmt(const ResolvedWhileStmt &stmt, int exit) {
   cfg.insertEdge(header, exit, val.value_or(0) == 0);
 
   cfg.insertStmt(&stmt, header);
-  insertExpr(*stmt.condition, header);
+  visit(*stmt.condition, header);
 
   return header;
 }
 
-int CFGBuilder::insertBreakStmt(const ResolvedBreakStmt &stmt, int block) {
+int CFGBuilder::visitBreakStmt(const BreakStmt &stmt, int block) {
   block = cfg.insertNewBlockBefore(cfg.exit, true);
 
   cfg.insertStmt(&stmt, block);
   return block;
 }
 
-int CFGBuilder::insertContinueStmt(const ResolvedContinueStmt &stmt, int block) {
+int CFGBuilder::visitContinueStmt(const ContinueStmt &stmt, int block) {
   block = cfg.insertNewBlockBefore(cfg.exit, true);
 
   cfg.insertStmt(&stmt, block);
   return block;
 }
 
-int CFGBuilder::insertDeclStmt(const ResolvedDeclStmt &stmt, int block) {
+int CFGBuilder::visitDeclStmt(const DeclStmt &stmt, int block) {
   cfg.insertStmt(&stmt, block);
 
   if (const auto &init = stmt.varDecl->initializer)
-    return insertExpr(*init, block);
+    return visit(*init, block);
 
   return block;
 }
 
-int CFGBuilder::insertAssignment(const ResolvedAssignment &stmt, int block) {
+int CFGBuilder::visitAssignment(const Assignment &stmt, int block) {
   cfg.insertStmt(&stmt, block);
-  return insertExpr(*stmt.expr, block);
+  return visit(*stmt.expr, block);
 }
 
-int CFGBuilder::insertReturnStmt(const ResolvedReturnStmt &stmt, int block) {
+int CFGBuilder::visitReturnStmt(const ReturnStmt &stmt, int block) {
   block = cfg.insertNewBlockBefore(cfg.exit, true);
 
   cfg.insertStmt(&stmt, block);
   if (stmt.expr)
-    return insertExpr(*stmt.expr, block);
+    return visit(*stmt.expr, block);
 
   return block;
 }
 
-int CFGBuilder::insertExpr(const ResolvedExpr &expr, int block) {
+int CFGBuilder::visitExpr(const Expr &expr, int block) {
   cfg.insertStmt(&expr, block);
-
-  if (const auto *call = dynamic_cast<const ResolvedCallExpr *>(&expr)) {
-    for (auto it = call->arguments.rbegin(); it != call->arguments.rend(); ++it)
-      insertExpr(**it, block);
-    return block;
-  }
-
-  if (const auto *grouping = dynamic_cast<const ResolvedGroupingExpr *>(&expr))
-    return insertExpr(*grouping->expr, block);
-
-  if (const auto *binop = dynamic_cast<const ResolvedBinaryOperator *>(&expr))
-    return insertExpr(*binop->rhs, block), insertExpr(*binop->lhs, block);
-
-  if (const auto *unop = dynamic_cast<const ResolvedUnaryOperator *>(&expr))
-    return insertExpr(*unop->operand, block);
-
   return block;
 }
 
-int CFGBuilder::insertStmt(const ResolvedStmt &stmt, int block) {
-  if (auto *ifStmt = dynamic_cast<const ResolvedIfStmt *>(&stmt))
-    return insertIfStmt(*ifStmt, block);
-
-  if (auto *whileStmt = dynamic_cast<const ResolvedWhileStmt *>(&stmt))
-    return insertWhileStmt(*whileStmt, block);
+int CFGBuilder::visitCallExpr(const CallExpr &call, int block) {
+  cfg.insertStmt(&call, block);
 
-  if (auto *breakStmt = dynamic_cast<const ResolvedBreakStmt *>(&stmt))
-    return insertBreakStmt(*breakStmt, block);
-
-  if (auto *continueStmt = dynamic_cast<const ResolvedContinueStmt *>(&stmt))
-    return insertContinueStmt(*continueStmt, block);
-
-  if (auto *expr = dynamic_cast<const ResolvedExpr *>(&stmt))
-    return insertExpr(*expr, block);
-
-  if (auto *assignment = dynamic_cast<const ResolvedAssignment *>(&stmt))
-    return insertAssignment(*assignment, block);
+  for (auto it = call.arguments.rbegin(); it != call.arguments.rend(); ++it)
+    visit(**it, block);
+  return block;
+}
 
-  if (auto *declStmt = dynamic_cast<const ResolvedDeclStmt *>(&stmt))
-    return insertDeclStmt(*declStmt, block);
+int CFGBuilder::visitGroupingExpr(const GroupingExpr &grouping, int block) {
+  cfg.insertStmt(&grouping, block);
+  return visit(*grouping.expr, block);
+}
 
-  if (auto *returnStmt = dynamic_cast<const ResolvedReturnStmt *>(&stmt))
-    return insertReturnStmt(*returnStmt, block);
+int CFGBuilder::visitBinaryOperator(const BinaryOperator &binop, int block) {
+  cfg.insertStmt(&binop, block);
+  return visit(*binop.rhs, block), visit(*binop.lhs, block);
+}
 
-  llvm_unreachable("unexpected statement type");
+int CFGBuilder::visitUnaryOperator(const UnaryOperator &unop, int block) {
+  cfg.insertStmt(&unop, block);
+  return visit(*unop.operand, block);
 }
 
-int CFGBuilder::insertBlock(const ResolvedBlock &block, int succ) {
+int CFGBuilder::insertBlock(const Block &block, int succ) {
   const auto &stmts = block.statements;
 
   bool insertNewBlock = true;
@@ -168,14 +154,16 @@ int CFGBuilder::insertBlock(const ResolvedBlock &block, int succ) {
     if (insertNewBlock && !isTerminator(**it))
       succ = cfg.insertNewBlockBefore(succ, true);
 
-    insertNewBlock = dynamic_cast<const ResolvedWhileStmt *>(it->get());
-    succ = insertStmt(**it, succ);
+    insertNewBlock = llvm::isa<WhileStmt>(it->get());
+    succ = visit(**it, succ);
   }
 
   return succ;
 }
 
-CFG CFGBuilder::build(const ResolvedFunctionDecl &fn) {
+CFG CFGBuilder::build(const FunctionDecl &fn) {
+  llvm::TimeTraceScope timeScope("CFGBuilder::build", fn.identifier.getName());
+
   cfg = {};
   cfg.exit = cfg.insertNewBlock();
 
@@ -1,18 +1,22 @@
+#include <llvm/IR/CFG.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/Host.h>
+#include <llvm/Support/TimeProfiler.h>
 
 #include "codegen.h"
 
 namespace syscall {
 Codegen::Codegen(
-    std::vector<std::unique_ptr<ResolvedFunctionDecl>> resolvedTree,
-    std::string_view sourcePath)
-    : resolvedTree(std::move(resolvedTree)),
+    llvm::ArrayRef<ASTPtr<FunctionDecl>> resolvedTree,
+    std::string_view sourcePath,
+    llvm::LLVMContext &context)
+    : resolvedTree(resolvedTree),
+      context(context),
       builder(context),
-      module("<translation_unit>", context) {
-  module.setSourceFileName(sourcePath);
-  module.setTargetTriple(llvm::sys::getDefaultTargetTriple());
+      module(std::make_unique<llvm::Module>("<translation_unit>", context)) {
+  module->setSourceFileName(sourcePath);
+  module->setTargetTriple(llvm::sys::getDefaultTargetTriple());
 }
 
 llvm::Type *Codegen::generateType(Type type) {
@@ -21,37 +25,21 @@ llvm::Type *Codegen::generateType(Type type) {
       return builder.getDoubleTy();
     case Type::Kind::Void:
       return builder.getVoidTy();
-    case Type::Kind::Int:
-      return builder.getInt32Ty(); // Assuming Syscall has 32-bit integers
-    // Add more cases for other types as needed
-    default:
-      llvm_unreachable("unknown type");
+    case Type::Kind::Custom:
+      llvm_unreachable("custom types are rejected by Sema");
   }
+
+  llvm_unreachable("unknown type");
 }
 
-llvm::Value *Codegen::generateStmt(const ResolvedStmt &stmt) {
-  if (auto *expr = dynamic_cast<const ResolvedExpr *>(&stmt))
+llvm::Value *Codegen::generateStmt(const Stmt &stmt) {
+  if (auto *expr = llvm::dyn_cast<Expr>(&stmt))
     return generateExpr(*expr);
 
-  if (auto *ifStmt = dynamic_cast<const ResolvedIfStmt *>(&stmt))
-    return generateIfStmt(*ifStmt);
-
-  if (auto *declStmt = dynamic_cast<const ResolvedDeclStmt *>(&stmt))
-    return generateDeclStmt(*declStmt);
-
-  if (auto *assignment = dynamic_cast<const ResolvedAssignment *>(&stmt))
-    return generateAssignment(*assignment);
-
-  if (auto *whileStmt = dynamic_cast<const ResolvedWhileStmt *>(&stmt))
-    return generateWhileStmt(*whileStmt);
-
-  if (auto *returnStmt = dynamic_cast<const ResolvedReturnStmt *>(&stmt))
-    return generateReturnStmt(*returnStmt);
-
-  llvm_unreachable("unknown statement");
+  return visit(stmt);
 }
 
-llvm::Value *Codegen::generateIfStmt(const ResolvedIfStmt &stmt) {
+llvm::Value *Codegen::visitIfStmt(const IfStmt &stmt) {
   llvm::Function *function = getCurrentFunction();
 
   auto *trueBB = llvm::BasicBlock::Create(context, "if.true");
@@ -82,7 +70,7 @@ llvm::Value *Codegen::generateIfStmt(const ResolvedIfStmt &stmt) {
   return nullptr;
 }
 
-llvm::Value *Codegen::generateWhileStmt(const ResolvedWhileStmt &stmt) {
+llvm::Value *Codegen::visitWhileStmt(const WhileStmt &stmt) {
   llvm::Function *function = getCurrentFunction();
 
   auto *header = llvm::BasicBlock::Create(context, "while.cond", function);
@@ -103,9 +91,9 @@ llvm::Value *Codegen::generateWhileStmt(const ResolvedWhileStmt &stmt) {
   return nullptr;
 }
 
-llvm::Value *Codegen::generateDeclStmt(const ResolvedDeclStmt &stmt) {
+llvm::Value *Codegen::visitDeclStmt(const DeclStmt &stmt) {
   const auto *decl = stmt.varDecl.get();
-  llvm::AllocaInst *var = allocateStackVariable(decl->identifier);
+  llvm::AllocaInst *var = allocateStackVariable(decl->identifier.getName());
 
   if (const auto &init = decl->initializer)
     builder.CreateStore(generateExpr(*init), var);
@@ -114,46 +102,51 @@ llvm::Value *Codegen::generateDeclStmt(const ResolvedDeclStmt &stmt) {
   return nullptr;
 }
 
-llvm::Value *Codegen::generateAssignment(const ResolvedAssignment &stmt) {
+llvm::Value *Codegen::visitAssignment(const Assignment &stmt) {
   return builder.CreateStore(generateExpr(*stmt.expr),
                              declarations[stmt.variable->decl]);
 }
 
-llvm::Value *Codegen::generateReturnStmt(const ResolvedReturnStmt &stmt) {
+llvm::Value *Codegen::visitReturnStmt(const ReturnStmt &stmt) {
   if (stmt.expr)
     builder.CreateStore(generateExpr(*stmt.expr), retVal);
 
   assert(retBB && "function with return stmt doesn't have a return block");
-  return builder.CreateBr(retBB);
-}
+  llvm::Value *br = builder.CreateBr(retBB);
 
-llvm::Value *Codegen::generateExpr(const ResolvedExpr &expr) {
-  if (auto *number = dynamic_cast<const ResolvedNumberLiteral *>(&expr))
-    return llvm::ConstantFP::get(builder.getDoubleTy(), number->value);
+  // The statements after a return are unreachable, but they still need an
+  // unterminated block to be emitted into.
+  builder.SetInsertPoint(llvm::BasicBlock::Create(context, "return.after",
+                                                  getCurrentFunction()));
+  return br;
+}
 
+llvm::Value *Codegen::generateExpr(const Expr &expr) {
   if (auto val = expr.getConstantValue())
     return llvm::ConstantFP::get(builder.getDoubleTy(), *val);
 
-  if (auto *dre = dynamic_cast<const ResolvedDeclRefExpr *>(&expr))
-    return builder.CreateLoad(builder.getDoubleTy(), declarations[dre->decl]);
-
-  if (auto *call = dynamic_cast<const ResolvedCallExpr *>(&expr))
-    return generateCallExpr(*call);
-
-  if (auto *grouping = dynamic_cast<const ResolvedGroupingExpr *>(&expr))
-    return generateExpr(*grouping->expr);
+  return visit(expr);
+}
 
-  if (auto *binop = dynamic_cast<const ResolvedBinaryOperator *>(&expr))
-    return generateBinaryOperator(*binop);
+llvm::Value *Codegen::visitNumberLiteral(const NumberLiteral &number) {
+  return llvm::ConstantFP::get(builder.getDoubleTy(), number.value);
+}
 
-  if (auto *unop = dynamic_cast<const ResolvedUnaryOperator *>(&expr))
-    return generateUnaryOperator(*unop);
+llvm::Value *Codegen::visitDeclRefExpr(const DeclRefExpr &dre) {
+  return builder.CreateLoad(builder.getDoubleTy(), declarations[dre.decl]);
+}
 
-  llvm_unreachable("unexpected expression");
+llvm::Value *Codegen::visitGroupingExpr(const GroupingExpr &grouping) {
+  return generateExpr(*grouping.expr);
 }
 
-llvm::Value *Codegen::generateCallExpr(const ResolvedCallExpr &call) {
-  llvm::Function *callee = module.getFunction(call.callee->identifier);
+llvm::Value *Codegen::visitCallExpr(const CallExpr &call) {
+  // When a single function is generated, the others are only declared once
+  // they are called.
+  if (!declarations.count(call.calleeDecl))
+    generateFunctionDecl(*call.calleeDecl);
+
+  auto *callee = llvm::cast<llvm::Function>(declarations[call.calleeDecl]);
 
   std::vector<llvm::Value *> args;
   for (auto &&arg : call.arguments)
@@ -162,7 +155,7 @@ llvm::Value *Codegen::generateCallExpr(const ResolvedCallExpr &call) {
   return builder.CreateCall(callee, args);
 }
 
-llvm::Value *Codegen::generateUnaryOperator(const ResolvedUnaryOperator &unop) {
+llvm::Value *Codegen::visitUnaryOperator(const UnaryOperator &unop) {
   llvm::Value *rhs = generateExpr(*unop.operand);
 
   if (unop.op == TokenKind::Excl)
@@ -174,11 +167,11 @@ llvm::Value *Codegen::generateUnaryOperator(const ResolvedUnaryOperator &unop) {
   llvm_unreachable("unknown unary op");
 }
 
-void Codegen::generateConditionalOperator(const ResolvedExpr &op,
+void Codegen::generateConditionalOperator(const Expr &op,
                                           llvm::BasicBlock *trueBB,
                                           llvm::BasicBlock *falseBB) {
   llvm::Function *function = getCurrentFunction();
-  const auto *binop = dynamic_cast<const ResolvedBinaryOperator *>(&op);
+  const auto *binop = llvm::dyn_cast<BinaryOperator>(&op);
 
   if (binop && binop->op == TokenKind::PipePipe) {
     llvm::BasicBlock *nextBB =
@@ -204,8 +197,7 @@ void Codegen::generateConditionalOperator(const ResolvedExpr &op,
   builder.CreateCondBr(val, trueBB, falseBB);
 }
 
-llvm::Value *
-Codegen::generateBinaryOperator(const ResolvedBinaryOperator &binop) {
+llvm::Value *Codegen::visitBinaryOperator(const BinaryOperator &binop) {
   TokenKind op = binop.op;
 
   if (op == TokenKind::AmpAmp || op == TokenKind::PipePipe) {
@@ -230,13 +222,11 @@ Codegen::generateBinaryOperator(const ResolvedBinaryOperator &binop) {
     builder.SetInsertPoint(mergeBB);
     llvm::PHINode *phi = builder.CreatePHI(builder.getInt1Ty(), 2);
 
-    for (auto it = pred_begin(rhsBB); it != pred_end(rhsBB); ++it) {
-      if (*it == rhsBB) {
-        phi->addIncoming(rhs, rhsBB);
-      }
-    }
+    // Every other predecessor short-circuited, so the result is known there.
+    for (llvm::BasicBlock *pred : llvm::predecessors(mergeBB))
+      phi->addIncoming(pred == rhsBB ? rhs : builder.getInt1(isOr), pred);
 
-    return phi;
+    return boolToDouble(phi);
   }
 
   llvm::Value *lhs = generateExpr(*binop.lhs);
@@ -247,22 +237,16 @@ Codegen::generateBinaryOperator(const ResolvedBinaryOperator &binop) {
       return builder.CreateFAdd(lhs, rhs);
     case TokenKind::Minus:
       return builder.CreateFSub(lhs, rhs);
-    case TokenKind::Star:
+    case TokenKind::Asterisk:
       return builder.CreateFMul(lhs, rhs);
     case TokenKind::Slash:
       return builder.CreateFDiv(lhs, rhs);
     case TokenKind::EqualEqual:
-      return builder.CreateFCmpOEQ(lhs, rhs);
-    case TokenKind::ExclEqual:
-      return builder.CreateFCmpUNE(lhs, rhs);
-    case TokenKind::Less:
-      return builder.CreateFCmpOLT(lhs, rhs);
-    case TokenKind::Greater:
-      return builder.CreateFCmpOGT(lhs, rhs);
-    case TokenKind::LessEqual:
-      return builder.CreateFCmpOLE(lhs, rhs);
-    case TokenKind::GreaterEqual:
-      return builder.CreateFCmpOGE(lhs, rhs);
+      return boolToDouble(builder.CreateFCmpOEQ(lhs, rhs));
+    case TokenKind::Lt:
+      return boolToDouble(builder.CreateFCmpOLT(lhs, rhs));
+    case TokenKind::Gt:
+      return boolToDouble(builder.CreateFCmpOGT(lhs, rhs));
     default:
       llvm_unreachable("unknown binary operator");
   }
@@ -277,18 +261,157 @@ llvm::Value *Codegen::boolToDouble(llvm::Value *value) {
                               llvm::ConstantFP::get(builder.getDoubleTy(), 0));
 }
 
-llvm::AllocaInst *Codegen::allocateStackVariable(const std::string &name) {
-  llvm::Function *function = getCurrentFunction();
-  llvm::IRBuilder<> tempBuilder(function->getEntryBlock().getFirstInsertionPt());
-  return tempBuilder.CreateAlloca(builder.getDoubleTy(), nullptr, name);
+llvm::AllocaInst *Codegen::allocateStackVariable(llvm::StringRef identifier) {
+  llvm::BasicBlock &entryBB = getCurrentFunction()->getEntryBlock();
+  llvm::IRBuilder<> tempBuilder(&entryBB, entryBB.getFirstInsertionPt());
+  return tempBuilder.CreateAlloca(builder.getDoubleTy(), nullptr, identifier);
 }
 
 llvm::Function *Codegen::getCurrentFunction() {
   return builder.GetInsertBlock()->getParent();
 }
 
-void Codegen::generateBlock(const ResolvedBlock &block) {
+void Codegen::generateBlock(const Block &block) {
   for (auto &stmt : block.statements)
-    generateStmt(stmt);
+    generateStmt(*stmt);
+}
+
+void Codegen::generateFunctionDecl(const FunctionDecl &functionDecl) {
+  llvm::TimeTraceScope timeScope("Codegen::generateFunctionDecl",
+                                 functionDecl.identifier.getName());
+
+  auto *retType = generateType(functionDecl.type);
+
+  std::vector<llvm::Type *> paramTypes;
+  for (auto &&param : functionDecl.params)
+    paramTypes.emplace_back(generateType(param->type));
+
+  auto *type = llvm::FunctionType::get(retType, paramTypes, false);
+
+  // Every module carries its own copy of the builtins, so they must not clash
+  // when several objects are linked together.
+  bool isBuiltin = !functionDecl.location.isValid();
+  // Calls find their callee through the declaration, not by name.
+  declarations[&functionDecl] = llvm::Function::Create(
+      type,
+      isBuiltin ? llvm::Function::InternalLinkage
+                : llvm::Function::ExternalLinkage,
+      functionDecl.identifier.getName(), *module);
+}
+
+void Codegen::generateFunctionBody(const FunctionDecl &functionDecl) {
+  llvm::TimeTraceScope timeScope("Codegen::generateFunctionBody",
+                                 functionDecl.identifier.getName());
+
+  auto *function = llvm::cast<llvm::Function>(declarations[&functionDecl]);
+
+  auto *entryBB = llvm::BasicBlock::Create(context, "entry", function);
+  builder.SetInsertPoint(entryBB);
+
+  bool isVoid = functionDecl.type.kind == Type::Kind::Void;
+  if (!isVoid)
+    retVal = allocateStackVariable("retval");
+  retBB = llvm::BasicBlock::Create(context, "return");
+
+  int idx = 0;
+  for (auto &&arg : function->args()) {
+    const auto *paramDecl = functionDecl.params[idx].get();
+    arg.setName(paramDecl->identifier.getName());
+
+    llvm::Value *var = allocateStackVariable(paramDecl->identifier.getName());
+    builder.CreateStore(&arg, var);
+
+    declarations[paramDecl] = var;
+    ++idx;
+  }
+
+  // println is the only builtin, and builtins have no source location.
+  if (!functionDecl.location.isValid())
+    generateBuiltinPrintlnBody(functionDecl);
+  else
+    generateBlock(*functionDecl.body);
+
+  if (retBB->hasNPredecessorsOrMore(1)) {
+    builder.CreateBr(retBB);
+    retBB->insertInto(function);
+    builder.SetInsertPoint(retBB);
+  }
+
+  if (isVoid) {
+    builder.CreateRetVoid();
+    return;
+  }
+
+  builder.CreateRet(builder.CreateLoad(builder.getDoubleTy(), retVal));
+}
+
+void Codegen::generateBuiltinPrintlnBody(const FunctionDecl &println) {
+  auto *type = llvm::FunctionType::get(builder.getInt32Ty(),
+                                       {builder.getInt8PtrTy()}, true);
+  auto *printf = llvm::Function::Create(type, llvm::Function::ExternalLinkage,
+                                        "printf", *module);
+  auto *format = builder.CreateGlobalStringPtr("%.15g\n");
+
+  llvm::Value *param = builder.CreateLoad(
+      builder.getDoubleTy(), declarations[println.params[0].get()]);
+
+  builder.CreateCall(printf, {format, param});
+}
+
+void Codegen::generateMainWrapper() {
+  auto *builtinMain = module->getFunction("main");
+  if (!builtinMain)
+    return;
+
+  // A module that only calls main refers to it by its new name too, but the
+  // wrapper belongs to the module that defines it.
+  builtinMain->setName("__builtin_main");
+  if (builtinMain->isDeclaration())
+    return;
+
+  auto *main = llvm::Function::Create(
+      llvm::FunctionType::get(builder.getInt32Ty(), {}, false),
+      llvm::Function::ExternalLinkage, "main", *module);
+
+  auto *entry = llvm::BasicBlock::Create(context, "entry", main);
+  builder.SetInsertPoint(entry);
+
+  // A program whose main returns a number exits with it, converted like a C
+  // cast to int. Otherwise it exits with 0.
+  llvm::Value *result = builder.CreateCall(builtinMain);
+  if (builtinMain->getReturnType()->isDoubleTy())
+    result = builder.CreateFPToSI(result, builder.getInt32Ty());
+  else
+    result = llvm::ConstantInt::getSigned(builder.getInt32Ty(), 0);
+
+  builder.CreateRet(result);
+}
+
+std::unique_ptr<llvm::Module> Codegen::generateIR() {
+  for (auto &&function : resolvedTree)
+    generateFunctionDecl(*function);
+
+  for (auto &&function : resolvedTree)
+    generateFunctionBody(*function);
+
+  generateMainWrapper();
+
+  return std::move(module);
+}
+
+std::unique_ptr<llvm::Module>
+Codegen::generateIR(const FunctionDecl &function) {
+  for (auto &&fn : resolvedTree)
+    if (!fn->location.isValid()) {
+      generateFunctionDecl(*fn);
+      generateFunctionBody(*fn);
+    }
+
+  generateFunctionDecl(function);
+  generateFunctionBody(function);
+
+  generateMainWrapper();
+
+  return std::move(module);
 }
-} // namespace syscall
\ No newline at end of file
+} // namespace syscall
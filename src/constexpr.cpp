@@ -13,8 +13,8 @@ std::optional<bool> toBool(std::optional<double> d) {
 
 namespace syscall {
 
-std::optional<double> ConstantExpressionEvaluator::evaluateBinaryOperator(
-    const ResolvedBinaryOperator &binop, bool allowSideEffects) {
+std::optional<double> ConstantExpressionEvaluator::visitBinaryOperator(
+    const BinaryOperator &binop, bool allowSideEffects) {
   std::optional<double> lhs = evaluate(*binop.lhs, allowSideEffects);
 
   if (!lhs && !allowSideEffects)
@@ -51,55 +51,51 @@ std::optional<double> ConstantExpressionEvaluator::evaluateBinaryOperator(
       return std::nullopt;
     }
 
+    default:
+      break;
+  }
+
+  // Arithmetic and comparisons are only known if both operands are.
+  std::optional<double> rhs = evaluate(*binop.rhs, allowSideEffects);
+  if (!lhs || !rhs)
+    return std::nullopt;
+
+  switch (binop.op) {
     case TokenKind::Asterisk: // Multiplication (*)
-      if (!lhs)
-        return std::nullopt;
-      return *lhs * evaluate(*binop.rhs, allowSideEffects).value_or(0.0);
+      return *lhs * *rhs;
 
     case TokenKind::Slash: // Division (/)
-      if (!lhs)
-        return std::nullopt;
-      return *lhs / evaluate(*binop.rhs, allowSideEffects).value_or(1.0); // Avoid division by zero
+      return *lhs / *rhs;
 
     case TokenKind::Plus: // Addition (+)
-      if (!lhs)
-        return std::nullopt;
-      return *lhs + evaluate(*binop.rhs, allowSideEffects).value_or(0.0);
+      return *lhs + *rhs;
 
     case TokenKind::Minus: // Subtraction (-)
-      if (!lhs)
-        return std::nullopt;
-      return *lhs - evaluate(*binop.rhs, allowSideEffects).value_or(0.0);
+      return *lhs - *rhs;
 
     case TokenKind::Lt: // Less than (<)
-      if (!lhs)
-        return std::nullopt;
-      return *lhs < evaluate(*binop.rhs, allowSideEffects).value_or(0.0) ? 1.0 : 0.0;
+      return *lhs < *rhs ? 1.0 : 0.0;
 
     case TokenKind::Gt: // Greater than (>)
-      if (!lhs)
-        return std::nullopt;
-      return *lhs > evaluate(*binop.rhs, allowSideEffects).value_or(0.0) ? 1.0 : 0.0;
+      return *lhs > *rhs ? 1.0 : 0.0;
 
     case TokenKind::EqualEqual: // Equality (==)
-      if (!lhs)
-        return std::nullopt;
-      return *lhs == evaluate(*binop.rhs, allowSideEffects).value_or(0.0) ? 1.0 : 0.0;
+      return *lhs == *rhs ? 1.0 : 0.0;
 
     default:
       llvm_unreachable("unexpected binary operator");
   }
 }
 
-std::optional<double> ConstantExpressionEvaluator::evaluateUnaryOperator(
-    const ResolvedUnaryOperator &unop, bool allowSideEffects) {
+std::optional<double> ConstantExpressionEvaluator::visitUnaryOperator(
+    const UnaryOperator &unop, bool allowSideEffects) {
   std::optional<double> operand = evaluate(*unop.operand, allowSideEffects);
   if (!operand)
     return std::nullopt;
 
   switch (unop.op) {
     case TokenKind::Excl: // Logical NOT (!)
-      return !toBool(operand) ? 1.0 : 0.0;
+      return *operand == 0.0 ? 1.0 : 0.0;
 
     case TokenKind::Minus: // Unary minus (-)
       return -*operand;
@@ -109,42 +105,33 @@ std::optional<double> ConstantExpressionEvaluator::evaluateUnaryOperator(
   }
 }
 
-std::optional<double> ConstantExpressionEvaluator::evaluateDeclRefExpr(
-    const ResolvedDeclRefExpr &dre, bool allowSideEffects) {
+std::optional<double> ConstantExpressionEvaluator::visitDeclRefExpr(
+    const DeclRefExpr &dre, bool allowSideEffects) {
   // We only care about references to immutable variables with an initializer.
-  const auto *rvd = dynamic_cast<const ResolvedVarDecl *>(dre.decl);
-  if (!rvd || rvd->isMutable || !rvd->initializer)
+  const auto *var = llvm::dyn_cast<VarDecl>(dre.decl);
+  if (!var || var->isMutable || !var->initializer)
     return std::nullopt;
 
-  return evaluate(*rvd->initializer, allowSideEffects);
+  return evaluate(*var->initializer, allowSideEffects);
+}
+
+std::optional<double> ConstantExpressionEvaluator::visitNumberLiteral(
+    const NumberLiteral &numberLiteral, bool /*allowSideEffects*/) {
+  return numberLiteral.value;
+}
+
+std::optional<double> ConstantExpressionEvaluator::visitGroupingExpr(
+    const GroupingExpr &grouping, bool allowSideEffects) {
+  return evaluate(*grouping.expr, allowSideEffects);
 }
 
 std::optional<double> ConstantExpressionEvaluator::evaluate(
-    const ResolvedExpr &expr, bool allowSideEffects) {
+    const Expr &expr, bool allowSideEffects) {
   // Don't evaluate the same expression multiple times.
   if (std::optional<double> val = expr.getConstantValue())
     return val;
 
-  if (const auto *numberLiteral =
-          dynamic_cast<const ResolvedNumberLiteral *>(&expr))
-    return numberLiteral->value;
-
-  if (const auto *groupingExpr =
-          dynamic_cast<const ResolvedGroupingExpr *>(&expr))
-    return evaluate(*groupingExpr->expr, allowSideEffects);
-
-  if (const auto *binaryOperator =
-          dynamic_cast<const ResolvedBinaryOperator *>(&expr))
-    return evaluateBinaryOperator(*binaryOperator, allowSideEffects);
-
-  if (const auto *unaryOperator =
-          dynamic_cast<const ResolvedUnaryOperator *>(&expr))
-    return evaluateUnaryOperator(*unaryOperator, allowSideEffects);
-
-  if (const auto *declRefExpr =
-          dynamic_cast<const ResolvedDeclRefExpr *>(&expr))
-    return evaluateDeclRefExpr(*declRefExpr, allowSideEffects);
-
-  return std::nullopt;
+  // Calls aren't evaluated, the visitor falls back to nullopt for them.
+  return visit(expr, allowSideEffects);
 }
 } // namespace syscall
\ No newline at end of file
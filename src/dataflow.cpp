@@ -0,0 +1,105 @@
+#include <llvm/Support/TimeProfiler.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "dataflow.h"
+
+namespace syscall {
+
+std::vector<int> computeReversePostOrder(const CFG &cfg) {
+  std::vector<int> order;
+  order.reserve(cfg.basicBlocks.size());
+  std::vector<bool> visited(cfg.basicBlocks.size());
+
+  // The walk keeps its own stack, so that deeply nested functions can't
+  // overflow the native one.
+  using SuccIterator = std::set<std::pair<int, bool>>::const_iterator;
+  std::vector<std::pair<int, SuccIterator>> stack;
+
+  auto walkFrom = [&](int root) {
+    if (visited[root])
+      return;
+
+    size_t begin = order.size();
+    visited[root] = true;
+    stack.emplace_back(root, cfg.basicBlocks[root].successors.begin());
+
+    while (!stack.empty()) {
+      auto &[bb, succ] = stack.back();
+      if (succ == cfg.basicBlocks[bb].successors.end()) {
+        order.emplace_back(bb);
+        stack.pop_back();
+        continue;
+      }
+
+      int next = (succ++)->first;
+      if (!visited[next]) {
+        visited[next] = true;
+        stack.emplace_back(next, cfg.basicBlocks[next].successors.begin());
+      }
+    }
+
+    std::reverse(order.begin() + begin, order.end());
+  };
+
+  if (cfg.entry >= 0)
+    walkFrom(cfg.entry);
+
+  for (int bb = cfg.basicBlocks.size() - 1; bb >= 0; --bb)
+    walkFrom(bb);
+
+  return order;
+}
+
+std::vector<llvm::BitVector> solveForwardDataflow(const CFG &cfg,
+                                                  unsigned numBits,
+                                                  DataflowTransferFn transfer) {
+  llvm::TimeTraceScope timeScope("solveForwardDataflow");
+
+  size_t numBlocks = cfg.basicBlocks.size();
+  std::vector<int> order = computeReversePostOrder(cfg);
+
+  std::vector<size_t> position(numBlocks);
+  for (size_t i = 0; i < order.size(); ++i)
+    position[order[i]] = i;
+
+  std::vector<llvm::BitVector> in(numBlocks, llvm::BitVector(numBits));
+  std::vector<llvm::BitVector> out(numBlocks, llvm::BitVector(numBits));
+  llvm::BitVector facts(numBits);
+
+  // A pass in reverse post-order sees the final facts of every forward
+  // edge, so only a change along a back edge needs another pass.
+  llvm::BitVector pending(numBlocks, true);
+  bool changedBackEdge = true;
+  while (changedBackEdge) {
+    changedBackEdge = false;
+
+    for (int bb : order) {
+      if (!pending.test(bb))
+        continue;
+      pending.reset(bb);
+
+      const auto &[preds, succs, stmts] = cfg.basicBlocks[bb];
+
+      in[bb].reset();
+      for (auto &&[pred, reachable] : preds)
+        in[bb] |= out[pred];
+
+      facts = in[bb];
+      transfer(bb, facts);
+      if (facts == out[bb])
+        continue;
+
+      std::swap(facts, out[bb]);
+      for (auto &&[succ, reachable] : succs) {
+        pending.set(succ);
+        changedBackEdge |= position[succ] <= position[bb];
+      }
+    }
+  }
+
+  return in;
+}
+
+} // namespace syscall
@@ -1,28 +1,83 @@
+#include <llvm/ADT/ScopeExit.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+
+#include <algorithm>
+#include <cstdlib>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
-#include <sstream>
+#include <iterator>
+#include <optional>
 #include <string>
+#include <tuple>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
+#include "cache.h"
 #include "cfg.h"
 #include "codegen.h"
+#include "flat_ast.h"
 #include "lexer.h"
 #include "parser.h"
 #include "sema.h"
+#include "server.h"
+#include "timer.h"
 
 using namespace syscall;
 
 namespace {
 void displayHelp() {
   std::cout << "Usage:\n"
-            << "  syscall-compiler [options] <source_file>\n\n"
+            << "  syscall-compiler [options] <source_file>...\n\n"
             << "Options:\n"
             << "  -h           display this message\n"
             << "  -o <file>    write executable to <file>\n"
+            << "  -O<level>    optimization level (0-3, default: 0)\n"
+            << "  -j <n>       compile up to <n> source files or, for a single\n"
+            << "               source file, function bodies in parallel\n"
+            << "  -server <socket>\n"
+            << "               serve compile requests on a Unix domain socket\n"
+            << "  -use-server <socket>\n"
+            << "               forward the compilation to a running server\n"
+            << "  -cache-dir <dir>\n"
+            << "               reuse objects of unchanged inputs from <dir>\n"
+            << "               (default: $SYSCALL_CACHE_DIR, if set)\n"
+            << "  -run         execute the program in-process using the JIT\n"
+            << "  -pretokenize lex each source file completely before parsing\n"
+            << "  -stream      compile one function at a time to bound peak memory,\n"
+            << "               emitting an object per function (bypasses the cache\n"
+            << "               and prevents inlining across functions at -O2/-O3)\n"
             << "  -ast-dump    print the abstract syntax tree\n"
             << "  -res-dump    print the resolved syntax tree\n"
             << "  -llvm-dump   print the LLVM module\n"
-            << "  -cfg-dump    print the control flow graph\n";
+            << "  -cfg-dump    print the control flow graph\n"
+            << "  -emit-flat-ast\n"
+            << "               write the parsed tree as one blob to the '-o'\n"
+            << "               file (default: <source>.ast)\n"
+            << "  -read-flat-ast <file>\n"
+            << "               compile the tree written by '-emit-flat-ast' to\n"
+            << "               <file> instead of parsing the source file\n"
+            << "  -time-phases report the time and memory spent in each phase\n"
+            << "  -ftime-trace[=<file>]\n"
+            << "               write a Chrome trace event JSON of the compilation\n"
+            << "  -ftime-trace-granularity=<us>\n"
+            << "               minimum duration of recorded spans (default: 500)\n";
 }
 
 [[noreturn]] void error(std::string_view msg) {
@@ -30,33 +85,78 @@ void displayHelp() {
   std::exit(1);
 }
 
+// Unlike error(), returns the exit code instead of exiting, which is what the
+// phases that run on worker threads need: exiting would destroy the state the
+// other workers are still using.
+int reportError(llvm::Error err) {
+  std::cerr << "error: " << llvm::toString(std::move(err)) << '\n';
+  return 1;
+}
+
+llvm::Error createError(const llvm::Twine &msg) {
+  return llvm::createStringError(llvm::inconvertibleErrorCode(), msg);
+}
+
 struct CompilerOptions {
-  std::filesystem::path source;
+  std::vector<std::filesystem::path> sources;
   std::filesystem::path output;
+  std::filesystem::path cacheDir;
+  std::filesystem::path server;
+  std::filesystem::path useServer;
+  std::filesystem::path readFlatAST;
   bool displayHelp = false;
   bool astDump = false;
   bool resDump = false;
   bool llvmDump = false;
   bool cfgDump = false;
+  bool emitFlatAST = false;
+  bool run = false;
+  bool pretokenize = false;
+  bool stream = false;
+  bool timePhases = false;
+  bool timeTrace = false;
+  std::string timeTraceFile;
+  unsigned timeTraceGranularity = 500;
+  unsigned optLevel = 0;
+  unsigned jobs = 0;
 };
 
 CompilerOptions parseArguments(int argc, const char **argv) {
   CompilerOptions options;
 
+  if (const char *cacheDir = std::getenv("SYSCALL_CACHE_DIR"))
+    options.cacheDir = cacheDir;
+
   int idx = 1;
   while (idx < argc) {
     std::string_view arg = argv[idx];
 
     if (arg[0] != '-') {
-      if (!options.source.empty())
-        error("unexpected argument '" + std::string(arg) + '\'');
-
-      options.source = arg;
+      options.sources.emplace_back(arg);
     } else {
       if (arg == "-h")
         options.displayHelp = true;
       else if (arg == "-o")
         options.output = ++idx >= argc ? "" : argv[idx];
+      else if (arg.size() == 3 && arg.substr(0, 2) == "-O" &&
+               arg[2] >= '0' && arg[2] <= '3')
+        options.optLevel = arg[2] - '0';
+      else if (arg == "-server")
+        options.server = ++idx >= argc ? "" : argv[idx];
+      else if (arg == "-use-server")
+        options.useServer = ++idx >= argc ? "" : argv[idx];
+      else if (arg == "-cache-dir")
+        options.cacheDir = ++idx >= argc ? "" : argv[idx];
+      else if (arg == "-j") {
+        if (++idx >= argc || !llvm::to_integer(argv[idx], options.jobs))
+          error("expected number of jobs after '-j'");
+      }
+      else if (arg == "-run")
+        options.run = true;
+      else if (arg == "-pretokenize")
+        options.pretokenize = true;
+      else if (arg == "-stream")
+        options.stream = true;
       else if (arg == "-ast-dump")
         options.astDump = true;
       else if (arg == "-res-dump")
@@ -65,6 +165,21 @@ CompilerOptions parseArguments(int argc, const char **argv) {
         options.llvmDump = true;
       else if (arg == "-cfg-dump")
         options.cfgDump = true;
+      else if (arg == "-emit-flat-ast")
+        options.emitFlatAST = true;
+      else if (arg == "-read-flat-ast")
+        options.readFlatAST = ++idx >= argc ? "" : argv[idx];
+      else if (arg == "-time-phases")
+        options.timePhases = true;
+      else if (arg == "-ftime-trace")
+        options.timeTrace = true;
+      else if (arg.substr(0, 13) == "-ftime-trace=") {
+        options.timeTrace = true;
+        options.timeTraceFile = arg.substr(13);
+      } else if (arg.substr(0, 25) == "-ftime-trace-granularity=") {
+        if (!llvm::to_integer(arg.substr(25), options.timeTraceGranularity))
+          error("invalid time trace granularity '" + std::string(arg) + '\'');
+      }
       else
         error("unexpected option '" + std::string(arg) + '\'');
     }
@@ -74,33 +189,330 @@ CompilerOptions parseArguments(int argc, const char **argv) {
 
   return options;
 }
-} // namespace
 
-int main(int argc, const char **argv) {
-  CompilerOptions options = parseArguments(argc, argv);
+llvm::CodeGenOpt::Level getCodeGenOptLevel(unsigned optLevel) {
+  switch (optLevel) {
+  case 0:
+    return llvm::CodeGenOpt::None;
+  case 1:
+    return llvm::CodeGenOpt::Less;
+  case 2:
+    return llvm::CodeGenOpt::Default;
+  default:
+    return llvm::CodeGenOpt::Aggressive;
+  }
+}
 
-  if (options.displayHelp) {
-    displayHelp();
-    return 0;
+llvm::OptimizationLevel getOptimizationLevel(unsigned optLevel) {
+  switch (optLevel) {
+  case 1:
+    return llvm::OptimizationLevel::O1;
+  case 2:
+    return llvm::OptimizationLevel::O2;
+  default:
+    return llvm::OptimizationLevel::O3;
   }
+}
 
-  if (options.source.empty())
-    error("no source file specified");
+llvm::Expected<std::unique_ptr<llvm::TargetMachine>>
+createTargetMachine(const std::string &triple, unsigned optLevel) {
+  std::string errorMsg;
+  const llvm::Target *target =
+      llvm::TargetRegistry::lookupTarget(triple, errorMsg);
+  if (!target)
+    return createError(errorMsg);
+
+  std::unique_ptr<llvm::TargetMachine> targetMachine(
+      target->createTargetMachine(triple, "generic", "", llvm::TargetOptions(),
+                                  llvm::Reloc::PIC_, llvm::None,
+                                  getCodeGenOptLevel(optLevel)));
+  if (!targetMachine)
+    return createError("cannot create a target machine for '" + triple + "'");
+
+  return std::move(targetMachine);
+}
+
+void optimizeModule(llvm::Module &module,
+                    llvm::TargetMachine &targetMachine,
+                    unsigned optLevel) {
+  if (optLevel == 0)
+    return;
+
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  llvm::PassBuilder passBuilder(&targetMachine);
+  passBuilder.registerModuleAnalyses(mam);
+  passBuilder.registerCGSCCAnalyses(cgam);
+  passBuilder.registerFunctionAnalyses(fam);
+  passBuilder.registerLoopAnalyses(lam);
+  passBuilder.crossRegisterProxies(lam, fam, cgam, mam);
+
+  llvm::ModulePassManager passManager =
+      passBuilder.buildPerModuleDefaultPipeline(getOptimizationLevel(optLevel));
+  passManager.run(module, mam);
+}
+
+llvm::Error emitObjectFile(llvm::Module &module,
+                           llvm::TargetMachine &targetMachine,
+                           llvm::SmallVectorImpl<char> &object) {
+  llvm::raw_svector_ostream os(object);
+  llvm::legacy::PassManager passManager;
+  if (targetMachine.addPassesToEmitFile(passManager, os, nullptr,
+                                        llvm::CGFT_ObjectFile))
+    return createError("the target can't emit object files");
+
+  passManager.run(module);
+  return llvm::Error::success();
+}
+
+int runModule(std::unique_ptr<llvm::Module> module,
+              std::unique_ptr<llvm::LLVMContext> context) {
+  llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> jit =
+      llvm::orc::LLJITBuilder().create();
+  if (!jit)
+    return reportError(jit.takeError());
+
+  // Let the program resolve libc symbols from the compiler process.
+  auto generator =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          (*jit)->getDataLayout().getGlobalPrefix());
+  if (!generator)
+    return reportError(generator.takeError());
+  (*jit)->getMainJITDylib().addGenerator(std::move(*generator));
+
+  if (llvm::Error err = (*jit)->addIRModule(
+          llvm::orc::ThreadSafeModule(std::move(module), std::move(context))))
+    return reportError(std::move(err));
+
+  llvm::Expected<llvm::JITEvaluatedSymbol> mainSymbol =
+      (*jit)->lookup("main");
+  if (!mainSymbol)
+    return reportError(mainSymbol.takeError());
+
+  auto *mainFn = llvm::jitTargetAddressToFunction<int (*)()>(
+      mainSymbol->getAddress());
+
+  return mainFn();
+}
+
+// The number of objects that are passed to the linker in memory.
+constexpr size_t maxInMemoryObjects = 64;
+
+int linkExecutable(llvm::ArrayRef<llvm::SmallVector<char, 0>> objects,
+                   const std::filesystem::path &output) {
+  llvm::ErrorOr<std::string> linker = llvm::sys::findProgramByName("clang");
+  if (!linker)
+    linker = llvm::sys::findProgramByName("cc");
+  if (!linker)
+    return reportError(createError("no linker driver found ('clang' or 'cc')"));
+
+  std::vector<std::string> objectPaths;
+  std::vector<int> fds;
+  std::vector<llvm::SmallString<128>> tmpPaths;
+
+  auto cleanup = llvm::make_scope_exit([&] {
+    for (int fd : fds)
+      llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+    for (auto &&tmpPath : tmpPaths)
+      llvm::sys::fs::remove(tmpPath);
+  });
+
+  auto writeFile = [](int fd, llvm::StringRef contents,
+                      const llvm::Twine &what) -> llvm::Error {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/false);
+    os << contents;
+    os.flush();
+    if (std::error_code ec = os.error()) {
+      // A stream that is destroyed with a pending error aborts.
+      os.clear_error();
+      return createError("failed to write " + what + ": " + ec.message());
+    }
 
-  if (options.source.extension() != ".sys")
-    error("unexpected source file extension");
+    return llvm::Error::success();
+  };
 
-  std::ifstream file(options.source);
-  if (!file)
-    error("failed to open '" + options.source.string() + '\'');
+  // Creates a temporary file with the given contents and closes it right
+  // away, so that the number of objects isn't limited by open descriptors.
+  auto writeTemporaryFile = [&](llvm::StringRef suffix,
+                                llvm::StringRef contents) -> llvm::Error {
+    int fd;
+    llvm::SmallString<128> &tmpPath = tmpPaths.emplace_back();
+    if (std::error_code ec =
+            llvm::sys::fs::createTemporaryFile("syscall", suffix, fd, tmpPath))
+      return createError("failed to create temporary file: " + ec.message());
 
-  std::stringstream buffer;
-  buffer << file.rdbuf();
-  SourceFile sourceFile{options.source.c_str(), buffer.str()};
+    llvm::Error err = writeFile(fd, contents, "temporary file");
+    llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+    return err;
+  };
 
-  Lexer lexer(sourceFile);
-  Parser parser(lexer);
-  auto [ast, success] = parser.parseSourceFile();
+  for (size_t i = 0; i < objects.size(); ++i) {
+    llvm::StringRef object(objects[i].data(), objects[i].size());
+
+#ifdef __linux__
+    // The first objects are handed to the linker through anonymous in-memory
+    // files that the child inherits, so they never have to touch the disk.
+    // They stay open until the linker is done, so their number is bounded.
+    if (i < maxInMemoryObjects) {
+      int fd = memfd_create("syscall-object", 0);
+      if (fd != -1) {
+        fds.emplace_back(fd);
+        if (llvm::Error err = writeFile(fd, object, "object file"))
+          return reportError(std::move(err));
+
+        objectPaths.emplace_back("/proc/self/fd/" + std::to_string(fd));
+        continue;
+      }
+    }
+#endif
+
+    if (llvm::Error err = writeTemporaryFile("o", object))
+      return reportError(std::move(err));
+    objectPaths.emplace_back(tmpPaths.back().str());
+  }
+
+  llvm::SmallVector<llvm::StringRef, 8> args{*linker};
+
+  // Sources compiled with -stream yield an object per function, which can be
+  // more than fit on a command line, so the paths go into a response file.
+  std::string responseFileArg;
+  if (objectPaths.size() > maxInMemoryObjects) {
+    std::string responseFile;
+    for (auto &&path : objectPaths) {
+      responseFile += '"';
+      for (char c : path) {
+        if (c == '"' || c == '\\')
+          responseFile += '\\';
+        responseFile += c;
+      }
+      responseFile += "\"\n";
+    }
+
+    if (llvm::Error err = writeTemporaryFile("rsp", responseFile))
+      return reportError(std::move(err));
+    responseFileArg = "@" + tmpPaths.back().str().str();
+    args.emplace_back(responseFileArg);
+  } else {
+    args.append(objectPaths.begin(), objectPaths.end());
+  }
+
+  std::string outputPath = output.string();
+  if (!outputPath.empty()) {
+    args.emplace_back("-o");
+    args.emplace_back(outputPath);
+  }
+
+  return llvm::sys::ExecuteAndWait(*linker, args);
+}
+
+// Reads the tree that '-emit-flat-ast' wrote for 'source' into 'ctx'.
+std::optional<std::vector<ASTPtr<FunctionDecl>>>
+loadFlatAST(const std::filesystem::path &path,
+            const SourceFile &source,
+            ASTContext &ctx) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> blob =
+      llvm::MemoryBuffer::getFile(path.string(), /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!blob) {
+    std::cerr << "error: failed to open '" << path.string()
+              << "': " << blob.getError().message() << '\n';
+    return std::nullopt;
+  }
+
+  std::optional<FlatAST> flat = FlatAST::read((*blob)->getBuffer());
+  std::optional<std::vector<ASTPtr<FunctionDecl>>> ast;
+  if (flat)
+    ast = flat->raise(ctx, source);
+
+  if (!ast)
+    std::cerr << "error: '" << path.string()
+              << "' is not a flat AST of '" << source.path << "'\n";
+  return ast;
+}
+
+// The threads a single source file may use to lex and analyze itself. When
+// there are several source files, each of them already runs on a thread of
+// the -j pool, and spawning more from there would oversubscribe the machine.
+unsigned getThreadsPerSource(const CompilerOptions &options) {
+  if (options.sources.size() != 1)
+    return 1;
+
+  return llvm::hardware_concurrency(options.jobs).compute_thread_count();
+}
+
+// Runs a single source file through the whole pipeline. On success the
+// object code is written to 'object', unless the options requested a dump or
+// JIT execution, in which case nothing is emitted. If a cache is given, the
+// object is looked up there first and stored there afterwards.
+int compileSourceFile(const std::filesystem::path &source,
+                      const CompilerOptions &options,
+                      const CompilationCache *cache,
+                      llvm::SmallVectorImpl<char> &object) {
+  std::optional<SourceFile> sourceFile;
+  {
+    PhaseTimerRAII timer("Source loading");
+    llvm::Expected<SourceFile> file = SourceFile::open(source.c_str());
+    if (!file) {
+      std::cerr << "error: failed to open '" << source.string()
+                << "': " << llvm::toString(file.takeError()) << '\n';
+      return 1;
+    }
+    sourceFile.emplace(std::move(*file));
+  }
+
+  std::string cacheKey;
+  std::optional<CompilationCache::EntryLock> cacheLock;
+  if (cache) {
+    PhaseTimerRAII timer("Cache lookup");
+
+    cacheKey = CompilationCache::computeKey(
+        sourceFile->buffer, {"-O" + std::to_string(options.optLevel),
+                             llvm::sys::getDefaultTargetTriple()});
+
+    // The entry stays locked until this function returns, so concurrent
+    // compilations of the same input wait for this one and reuse its result.
+    cacheLock.emplace(cache->lock(cacheKey));
+    if (cache->load(cacheKey, object))
+      return 0;
+  }
+
+  // The tree lives in this arena and Sema resolves it in place, so the arena
+  // has to be destroyed after it.
+  ASTContext astContext;
+
+  std::vector<ASTPtr<FunctionDecl>> ast;
+  bool success = true;
+  if (!options.readFlatAST.empty()) {
+    PhaseTimerRAII timer("Flat AST loading");
+    std::optional<std::vector<ASTPtr<FunctionDecl>>> loaded =
+        loadFlatAST(options.readFlatAST, *sourceFile, astContext);
+    if (!loaded)
+      return 1;
+
+    ast = std::move(*loaded);
+  } else {
+    // By default the parser pulls tokens from the lexer on demand, so lexing
+    // is measured as part of parsing.
+    std::optional<Lexer> lexer;
+    std::optional<TokenStream> tokens;
+    std::optional<Parser> parser;
+    if (options.pretokenize) {
+      PhaseTimerRAII lexTimer("Lexing");
+      tokens.emplace(
+          TokenStream::lex(*sourceFile, getThreadsPerSource(options)));
+      parser.emplace(*tokens, astContext);
+    } else {
+      lexer.emplace(*sourceFile);
+      parser.emplace(*lexer, astContext);
+    }
+
+    PhaseTimerRAII parseTimer(options.pretokenize ? "Parsing"
+                                                  : "Lexing and parsing");
+    std::tie(ast, success) = parser->parseSourceFile();
+  }
 
   if (options.astDump) {
     for (auto &&fn : ast)
@@ -111,8 +523,35 @@ int main(int argc, const char **argv) {
   if (!success)
     return 1;
 
-  Sema sema(std::move(ast));
-  auto resolvedTree = sema.resolveAST();
+  if (options.emitFlatAST) {
+    PhaseTimerRAII timer("Flat AST emission");
+    std::filesystem::path output = options.output;
+    if (output.empty())
+      output = std::filesystem::path(source).replace_extension(".ast");
+
+    std::error_code errorCode;
+    llvm::raw_fd_ostream os(output.string(), errorCode);
+    if (errorCode) {
+      std::cerr << "error: failed to open '" << output.string()
+                << "': " << errorCode.message() << '\n';
+      return 1;
+    }
+
+    std::optional<FlatAST> flat = FlatAST::lower(ast, *sourceFile);
+    if (!flat) {
+      std::cerr << "error: '" << source.string()
+                << "' has too many statements of one kind for a flat AST\n";
+      return 1;
+    }
+
+    flat->write(os);
+    return 0;
+  }
+
+  std::optional<PhaseTimerRAII> semaTimer("Semantic analysis");
+  Sema sema(astContext, std::move(ast));
+  auto resolvedTree = sema.resolveAST(getThreadsPerSource(options));
+  semaTimer.reset();
 
   if (options.resDump) {
     for (auto &&fn : resolvedTree)
@@ -131,31 +570,293 @@ int main(int argc, const char **argv) {
   if (resolvedTree.empty())
     return 1;
 
-  Codegen codegen(std::move(resolvedTree), options.source.c_str());
-  llvm::Module *llvmIR = codegen.generateIR();
+  auto context = std::make_unique<llvm::LLVMContext>();
+  std::optional<PhaseTimerRAII> codegenTimer("Code generation");
+  Codegen codegen(resolvedTree, source.c_str(), *context);
+  std::unique_ptr<llvm::Module> llvmIR = codegen.generateIR();
+  codegenTimer.reset();
+
+  llvm::Expected<std::unique_ptr<llvm::TargetMachine>> targetMachine =
+      createTargetMachine(llvmIR->getTargetTriple(), options.optLevel);
+  if (!targetMachine)
+    return reportError(targetMachine.takeError());
+  llvmIR->setDataLayout((*targetMachine)->createDataLayout());
+
+  {
+    PhaseTimerRAII timer("Optimization");
+    optimizeModule(*llvmIR, **targetMachine, options.optLevel);
+  }
 
   if (options.llvmDump) {
     llvmIR->dump();
     return 0;
   }
 
-  // Theoretically this can still generate the same tmp files for 2 different
-  // invocations and remove them later.
-  std::stringstream path;
-  path << "tmp-" << std::filesystem::hash_value(options.source) << ".ll";
-  const std::string &llvmIRPath = path.str();
+  if (options.run) {
+    PhaseTimerRAII timer("JIT execution");
+    return runModule(std::move(llvmIR), std::move(context));
+  }
+
+  PhaseTimerRAII timer("Object emission");
+  if (llvm::Error err = emitObjectFile(*llvmIR, **targetMachine, object))
+    return reportError(std::move(err));
+
+  if (cache)
+    cache->store(cacheKey, object);
+
+  return 0;
+}
+
+// Compiles a source file one function at a time. Only the signatures of the
+// file stay in memory, the tree and the IR of a body are released as soon as
+// its object is emitted. Every function gets an object of its own, which is
+// why the cache, storing one object per source file, isn't used.
+int streamSourceFile(const std::filesystem::path &source,
+                     const CompilerOptions &options,
+                     std::vector<llvm::SmallVector<char, 0>> &objects) {
+  std::optional<SourceFile> sourceFile;
+  {
+    PhaseTimerRAII timer("Source loading");
+    llvm::Expected<SourceFile> file = SourceFile::open(source.c_str());
+    if (!file) {
+      std::cerr << "error: failed to open '" << source.string()
+                << "': " << llvm::toString(file.takeError()) << '\n';
+      return 1;
+    }
+    sourceFile.emplace(std::move(*file));
+  }
+
+  // Holds the signatures for the whole file. Every body is parsed into a
+  // context of its own, which interns its names in this one.
+  ASTContext signatureContext;
+
+  std::optional<TokenStream> tokens;
+  if (options.pretokenize) {
+    PhaseTimerRAII lexTimer("Lexing");
+    tokens.emplace(
+        TokenStream::lex(*sourceFile, getThreadsPerSource(options)));
+  }
+
+  auto createParser = [&](std::optional<Lexer> &lexer) {
+    if (tokens)
+      return Parser(*tokens, signatureContext);
+
+    lexer.emplace(*sourceFile);
+    return Parser(*lexer, signatureContext);
+  };
+
+  // The first pass skips the bodies, so that every function is known before
+  // the first body is resolved.
+  std::vector<ASTPtr<FunctionDecl>> signatures;
+  {
+    PhaseTimerRAII timer("Signature parsing");
+    std::optional<Lexer> lexer;
+    Parser parser = createParser(lexer);
+    parser.setSkipFunctionBodies(true);
+
+    auto [ast, success] = parser.parseSourceFile();
+    if (!success)
+      return 1;
+    signatures = std::move(ast);
+  }
+
+  Sema sema(signatureContext, std::move(signatures));
+  {
+    PhaseTimerRAII timer("Semantic analysis");
+    if (!sema.resolveFunctionDeclarations())
+      return 1;
+  }
+
+  llvm::Expected<std::unique_ptr<llvm::TargetMachine>> targetMachine =
+      createTargetMachine(llvm::sys::getDefaultTargetTriple(),
+                          options.optLevel);
+  if (!targetMachine)
+    return reportError(targetMachine.takeError());
+
+  std::optional<Lexer> lexer;
+  Parser parser = createParser(lexer);
+
+  // After an error the remaining bodies are still checked, but no more
+  // objects are emitted.
+  bool error = false;
+  for (auto &&fn : sema.getFunctions()) {
+    // The builtins don't come from the source file.
+    if (!fn->location.isValid())
+      continue;
+
+    ASTContext bodyContext(signatureContext);
+    // The body has to be destroyed before the arena it lives in.
+    auto releaseBody = llvm::make_scope_exit([&] { fn->body = nullptr; });
+
+    {
+      PhaseTimerRAII timer(options.pretokenize ? "Parsing"
+                                               : "Lexing and parsing");
+      ASTPtr<FunctionDecl> parsed = parser.parseFunctionDecl(bodyContext);
+      if (!parsed)
+        return 1;
+
+      fn->body = std::move(parsed->body);
+    }
+
+    {
+      PhaseTimerRAII timer("Semantic analysis");
+      error |= !sema.resolveFunctionBody(*fn);
+    }
+
+    if (error)
+      continue;
+
+    llvm::LLVMContext context;
+    std::unique_ptr<llvm::Module> llvmIR;
+    {
+      PhaseTimerRAII timer("Code generation");
+      llvmIR = Codegen(sema.getFunctions(), source.c_str(), context)
+                   .generateIR(*fn);
+    }
+    llvmIR->setDataLayout((*targetMachine)->createDataLayout());
+
+    {
+      PhaseTimerRAII timer("Optimization");
+      optimizeModule(*llvmIR, **targetMachine, options.optLevel);
+    }
+
+    PhaseTimerRAII timer("Object emission");
+    if (llvm::Error err = emitObjectFile(*llvmIR, **targetMachine,
+                                         objects.emplace_back()))
+      return reportError(std::move(err));
+  }
+
+  return error ? 1 : 0;
+}
+
+int compileAndLink(const CompilerOptions &options) {
+  if (options.run || options.astDump || options.resDump || options.cfgDump ||
+      options.llvmDump || options.emitFlatAST || !options.readFlatAST.empty()) {
+    if (options.sources.size() != 1)
+      error("'-run', '-emit-flat-ast', '-read-flat-ast' and the dump options "
+            "expect exactly one source file");
+
+    llvm::SmallVector<char, 0> object;
+    return compileSourceFile(options.sources.front(), options, nullptr, object);
+  }
+
+  std::optional<CompilationCache> cache;
+  if (!options.cacheDir.empty()) {
+    cache.emplace(options.cacheDir);
+    if (!cache->initialize()) {
+      std::cerr << "warning: failed to create cache directory '"
+                << options.cacheDir.string() << "'\n";
+      cache.reset();
+    }
+  }
+
+  // Every source file is compiled in its own LLVMContext on a worker thread,
+  // and the resulting objects are linked together at the end. A streamed
+  // source file yields an object per function.
+  std::vector<std::vector<llvm::SmallVector<char, 0>>> objects(
+      options.sources.size());
+  std::vector<int> results(options.sources.size());
+  {
+    llvm::ThreadPool pool(llvm::hardware_concurrency(options.jobs));
+    for (size_t i = 0; i < options.sources.size(); ++i)
+      pool.async([&, i] {
+        TimeTraceThreadRAII timeTrace(options.sources[i].string());
+
+        if (options.stream)
+          results[i] =
+              streamSourceFile(options.sources[i], options, objects[i]);
+        else
+          results[i] =
+              compileSourceFile(options.sources[i], options,
+                                cache ? &*cache : nullptr,
+                                objects[i].emplace_back());
+      });
+    pool.wait();
+  }
+
+  for (int result : results)
+    if (result != 0)
+      return result;
+
+  std::vector<llvm::SmallVector<char, 0>> linkedObjects;
+  for (auto &&sourceObjects : objects)
+    std::move(sourceObjects.begin(), sourceObjects.end(),
+              std::back_inserter(linkedObjects));
+
+  PhaseTimerRAII timer("Linking");
+  return linkExecutable(linkedObjects, options.output);
+}
+
+int runCompiler(const CompilerOptions &options, const char *argv0) {
+  if (options.displayHelp) {
+    displayHelp();
+    return 0;
+  }
+
+  if (options.sources.empty())
+    error("no source file specified");
+
+  for (auto &&source : options.sources)
+    if (source.extension() != ".sys")
+      error("unexpected source file extension");
+
+  if (options.timePhases)
+    TimingReport::get().enable();
+
+  if (options.timeTrace)
+    initializeTimeTrace(options.timeTraceGranularity, argv0);
+
+  int ret = compileAndLink(options);
 
-  std::error_code errorCode;
-  llvm::raw_fd_ostream f(llvmIRPath, errorCode);
-  llvmIR->print(f, nullptr);
+  if (options.timePhases)
+    TimingReport::get().print(llvm::errs());
 
-  std::stringstream command;
-  command << "clang " << llvmIRPath;
-  if (!options.output.empty())
-    command << " -o " << options.output;
+  if (options.timeTrace) {
+    std::string traceFile = options.timeTraceFile;
+    if (traceFile.empty()) {
+      std::filesystem::path base = options.output;
+      if (base.empty())
+        base = options.sources.front().stem();
+      traceFile = base.string() + ".json";
+    }
 
-  int ret = std::system(command.str().c_str());
-  std::filesystem::remove(llvmIRPath);
+    if (llvm::Error err = llvm::timeTraceProfilerWrite(traceFile, ""))
+      error(llvm::toString(std::move(err)));
+    llvm::timeTraceProfilerCleanup();
+  }
 
   return ret;
 }
+} // namespace
+
+int main(int argc, const char **argv) {
+  CompilerOptions options = parseArguments(argc, argv);
+
+  if (!options.useServer.empty() && options.server.empty()) {
+    std::vector<std::string> args;
+    for (int i = 0; i < argc; ++i) {
+      if (std::string_view(argv[i]) == "-use-server") {
+        ++i;
+        continue;
+      }
+
+      args.emplace_back(argv[i]);
+    }
+
+    // Fall back to compiling in this process if the server is unreachable.
+    if (std::optional<int> ret = forwardToCompileServer(options.useServer, args))
+      return *ret;
+  }
+
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  if (!options.server.empty())
+    return runCompileServer(options.server.string(),
+                            [](int argc, const char **argv) {
+                              return runCompiler(parseArguments(argc, argv),
+                                                 argv[0]);
+                            });
+
+  return runCompiler(options, argv[0]);
+}
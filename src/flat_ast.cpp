@@ -0,0 +1,661 @@
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/TimeProfiler.h>
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+#include "ast_visitor.h"
+#include "flat_ast.h"
+
+namespace syscall {
+namespace {
+constexpr char blobMagic[4] = {'S', 'Y', 'F', 'A'};
+constexpr uint32_t blobVersion = 4;
+
+// Arrays in the blob start at multiples of this.
+constexpr size_t blobAlignment = 8;
+
+size_t alignToBlob(size_t size) {
+  return (size + blobAlignment - 1) / blobAlignment * blobAlignment;
+}
+
+template <typename... T>
+constexpr bool hasNoPadding = (std::has_unique_object_representations_v<T> &&
+                               ...);
+
+static_assert(hasNoPadding<flat::Type, flat::Block, flat::IfStmt,
+                           flat::WhileStmt, flat::ReturnStmt, flat::BreakStmt,
+                           flat::ContinueStmt, flat::DeclStmt, flat::Assignment,
+                           flat::DeclRefExpr, flat::CallExpr,
+                           flat::GroupingExpr, flat::BinaryOperator,
+                           flat::UnaryOperator, flat::ReadRegisterExpr,
+                           flat::LogExpr, flat::ParamDecl, flat::VarDecl,
+                           flat::FunctionDecl>,
+              "flat nodes must not have implicit padding");
+// A double has no unique object representation, so only the size is checked.
+static_assert(sizeof(flat::NumberLiteral) ==
+                  2 * sizeof(uint32_t) + sizeof(double),
+              "flat nodes must not have implicit padding");
+
+template <typename T> NodeIdx push(std::vector<T> &array, const T &node) {
+  array.emplace_back(node);
+  return array.size() - 1;
+}
+
+class FlatASTBuilder : public ASTVisitor<FlatASTBuilder, StmtRef> {
+  friend ASTVisitor<FlatASTBuilder, StmtRef>;
+
+  FlatAST &flat;
+  uint32_t fileStart;
+  llvm::StringMap<NodeIdx> names;
+
+  flat::FileOffset lowerLocation(SourceLocation location) {
+    assert(location.offset >= fileStart && "node from another source file");
+    return location.offset - fileStart;
+  }
+
+  StmtRef makeRef(Stmt::Kind kind, NodeIdx index) {
+    if (index > StmtRef::MaxIndex) {
+      tooManyStmts = true;
+      return StmtRef();
+    }
+
+    return StmtRef(kind, index);
+  }
+
+  NodeIdx lowerName(llvm::StringRef name) {
+    auto [it, inserted] = names.try_emplace(name, InvalidIdx);
+    if (!inserted)
+      return it->second;
+
+    auto offset = static_cast<uint32_t>(flat.nameChars.size());
+    flat.nameChars.insert(flat.nameChars.end(), name.begin(), name.end());
+    flat.nameChars.emplace_back('\0');
+    return it->second = push(flat.nameOffsets, offset);
+  }
+
+  NodeIdx lowerName(Symbol symbol) { return lowerName(symbol.getName()); }
+
+  static uint8_t lowerOperator(TokenKind op) {
+    return static_cast<uint8_t>(op);
+  }
+
+  flat::Type lowerType(const Type &type) {
+    return {type.kind, lowerName(type.name)};
+  }
+
+  StmtRef lowerExpr(const Expr *expr) {
+    return expr ? visit(*expr) : StmtRef();
+  }
+
+  // The elements of a list are lowered first, so that the lists nested in
+  // them don't end up in the middle of it.
+  template <typename T>
+  IdxRange lowerList(const std::vector<ASTPtr<T>> &list) {
+    llvm::SmallVector<StmtRef, 8> refs;
+    for (auto &&node : list)
+      refs.emplace_back(visit(*node));
+
+    IdxRange range{static_cast<NodeIdx>(flat.stmtLists.size()),
+                   static_cast<uint32_t>(refs.size())};
+    flat.stmtLists.insert(flat.stmtLists.end(), refs.begin(), refs.end());
+    return range;
+  }
+
+  NodeIdx lowerBlock(const Block *block) {
+    if (!block)
+      return InvalidIdx;
+
+    return push(flat.blocks, {lowerLocation(block->location),
+                              lowerList(block->statements)});
+  }
+
+  NodeIdx lowerVarDecl(const VarDecl &decl) {
+    flat::Type type{Type::Kind::Custom, InvalidIdx};
+    if (decl.type)
+      type = lowerType(*decl.type);
+
+    return push(flat.varDecls,
+                {lowerLocation(decl.location), lowerName(decl.identifier),
+                 type, lowerExpr(decl.initializer.get()), decl.isMutable});
+  }
+
+  StmtRef visitIfStmt(const IfStmt &stmt) {
+    flat::IfStmt node{lowerLocation(stmt.location), visit(*stmt.condition),
+                      lowerBlock(stmt.trueBlock.get()),
+                      lowerBlock(stmt.falseBlock.get())};
+    return makeRef(Stmt::Kind::IfStmt, push(flat.ifStmts, node));
+  }
+
+  StmtRef visitWhileStmt(const WhileStmt &stmt) {
+    flat::WhileStmt node{lowerLocation(stmt.location), visit(*stmt.condition),
+                         lowerBlock(stmt.body.get())};
+    return makeRef(Stmt::Kind::WhileStmt, push(flat.whileStmts, node));
+  }
+
+  StmtRef visitReturnStmt(const ReturnStmt &stmt) {
+    flat::ReturnStmt node{lowerLocation(stmt.location),
+                          lowerExpr(stmt.expr.get())};
+    return makeRef(Stmt::Kind::ReturnStmt, push(flat.returnStmts, node));
+  }
+
+  StmtRef visitBreakStmt(const BreakStmt &stmt) {
+    flat::BreakStmt node{lowerLocation(stmt.location)};
+    return makeRef(Stmt::Kind::BreakStmt, push(flat.breakStmts, node));
+  }
+
+  StmtRef visitContinueStmt(const ContinueStmt &stmt) {
+    flat::ContinueStmt node{lowerLocation(stmt.location)};
+    return makeRef(Stmt::Kind::ContinueStmt, push(flat.continueStmts, node));
+  }
+
+  StmtRef visitDeclStmt(const DeclStmt &stmt) {
+    flat::DeclStmt node{lowerLocation(stmt.location),
+                        lowerVarDecl(*stmt.varDecl)};
+    return makeRef(Stmt::Kind::DeclStmt, push(flat.declStmts, node));
+  }
+
+  StmtRef visitAssignment(const Assignment &stmt) {
+    flat::Assignment node{lowerLocation(stmt.location), visit(*stmt.variable),
+                          visit(*stmt.expr)};
+    return makeRef(Stmt::Kind::Assignment, push(flat.assignments, node));
+  }
+
+  StmtRef visitNumberLiteral(const NumberLiteral &expr) {
+    flat::NumberLiteral node{lowerLocation(expr.location), 0, expr.value};
+    return makeRef(Stmt::Kind::NumberLiteral, push(flat.numberLiterals, node));
+  }
+
+  StmtRef visitDeclRefExpr(const DeclRefExpr &expr) {
+    flat::DeclRefExpr node{lowerLocation(expr.location),
+                           lowerName(expr.identifier)};
+    return makeRef(Stmt::Kind::DeclRefExpr, push(flat.declRefExprs, node));
+  }
+
+  StmtRef visitCallExpr(const CallExpr &expr) {
+    flat::CallExpr node{lowerLocation(expr.location), visit(*expr.callee),
+                        lowerList(expr.arguments)};
+    return makeRef(Stmt::Kind::CallExpr, push(flat.callExprs, node));
+  }
+
+  StmtRef visitGroupingExpr(const GroupingExpr &expr) {
+    flat::GroupingExpr node{lowerLocation(expr.location), visit(*expr.expr)};
+    return makeRef(Stmt::Kind::GroupingExpr, push(flat.groupingExprs, node));
+  }
+
+  StmtRef visitBinaryOperator(const BinaryOperator &expr) {
+    flat::BinaryOperator node{lowerLocation(expr.location), visit(*expr.lhs),
+                              visit(*expr.rhs), lowerOperator(expr.op)};
+    return makeRef(Stmt::Kind::BinaryOperator,
+                   push(flat.binaryOperators, node));
+  }
+
+  StmtRef visitUnaryOperator(const UnaryOperator &expr) {
+    flat::UnaryOperator node{lowerLocation(expr.location),
+                             visit(*expr.operand), lowerOperator(expr.op)};
+    return makeRef(Stmt::Kind::UnaryOperator, push(flat.unaryOperators, node));
+  }
+
+  StmtRef visitReadRegisterExpr(const ReadRegisterExpr &expr) {
+    flat::ReadRegisterExpr node{lowerLocation(expr.location),
+                                lowerName(expr.address)};
+    return makeRef(Stmt::Kind::ReadRegisterExpr,
+                   push(flat.readRegisterExprs, node));
+  }
+
+  StmtRef visitLogExpr(const LogExpr &expr) {
+    flat::LogExpr node{lowerLocation(expr.location), visit(*expr.expr)};
+    return makeRef(Stmt::Kind::LogExpr, push(flat.logExprs, node));
+  }
+
+public:
+  bool tooManyStmts = false;
+
+  FlatASTBuilder(FlatAST &flat, const SourceFile &source)
+      : flat(flat),
+        fileStart(source.startOffset) {}
+
+  void lowerFunctionDecl(const FunctionDecl &fn) {
+    IdxRange params{static_cast<NodeIdx>(flat.paramDecls.size()),
+                    static_cast<uint32_t>(fn.params.size())};
+    for (auto &&param : fn.params)
+      flat.paramDecls.push_back({lowerLocation(param->location),
+                                 lowerName(param->identifier),
+                                 lowerType(param->type)});
+
+    flat.functionDecls.push_back({lowerLocation(fn.location),
+                                  lowerName(fn.identifier), lowerType(fn.type),
+                                  params, lowerBlock(fn.body.get())});
+  }
+};
+
+// Every node is raised at most once per reference to it, and the number of
+// nodes raised is bounded by the size of the tree, so a blob whose references
+// form a cycle is rejected instead of being followed forever.
+class FlatASTRaiser {
+  const FlatAST &flat;
+  ASTContext &ctx;
+  const SourceFile &source;
+  size_t remainingNodes;
+  bool valid = true;
+
+  // Returns the node at 'idx' of 'array', or nullptr if there is none.
+  template <typename T>
+  const T *getNode(const std::vector<T> &array, NodeIdx idx) {
+    if (!valid || idx >= array.size() || remainingNodes == 0) {
+      valid = false;
+      return nullptr;
+    }
+
+    --remainingNodes;
+    return &array[idx];
+  }
+
+  SourceLocation raiseLocation(flat::FileOffset offset) {
+    // The location one past the end is where Eof is reported.
+    if (offset > source.buffer.size()) {
+      valid = false;
+      return {};
+    }
+
+    return source.getLocation(offset);
+  }
+
+  Symbol raiseName(NodeIdx name) {
+    if (name >= flat.nameOffsets.size()) {
+      valid = false;
+      return ctx.intern("");
+    }
+
+    return ctx.intern(flat.getName(name));
+  }
+
+  Type raiseType(const flat::Type &type) {
+    switch (type.kind) {
+    case Type::Kind::Void:
+      return Type::builtinVoid();
+    case Type::Kind::Number:
+      return Type::builtinNumber();
+    case Type::Kind::Custom:
+      break;
+    default:
+      valid = false;
+      return Type::builtinVoid();
+    }
+
+    return Type::custom(raiseName(type.name).str());
+  }
+
+  TokenKind raiseBinaryOperator(uint8_t op) {
+    auto kind = static_cast<TokenKind>(static_cast<char>(op));
+    switch (kind) {
+    case TokenKind::Plus:
+    case TokenKind::Minus:
+    case TokenKind::Asterisk:
+    case TokenKind::Slash:
+    case TokenKind::EqualEqual:
+    case TokenKind::AmpAmp:
+    case TokenKind::PipePipe:
+    case TokenKind::Lt:
+    case TokenKind::Gt:
+      return kind;
+    default:
+      valid = false;
+      return TokenKind::Plus;
+    }
+  }
+
+  TokenKind raiseUnaryOperator(uint8_t op) {
+    auto kind = static_cast<TokenKind>(static_cast<char>(op));
+    if (kind != TokenKind::Excl && kind != TokenKind::Minus) {
+      valid = false;
+      return TokenKind::Minus;
+    }
+
+    return kind;
+  }
+
+  bool raiseFlag(uint8_t flag) {
+    if (flag > 1)
+      valid = false;
+
+    return flag == 1;
+  }
+
+  template <typename T> ASTPtr<T> raiseRef(StmtRef ref) {
+    ASTPtr<Stmt> stmt = raiseStmt(ref);
+    if (!stmt || !llvm::isa<T>(stmt.get())) {
+      valid = false;
+      return nullptr;
+    }
+
+    return ASTPtr<T>(llvm::cast<T>(stmt.release()));
+  }
+
+  ASTPtr<Expr> raiseOptionalExpr(StmtRef ref) {
+    return ref.isValid() ? raiseRef<Expr>(ref) : nullptr;
+  }
+
+  template <typename T> std::vector<ASTPtr<T>> raiseList(IdxRange range) {
+    std::vector<ASTPtr<T>> list;
+    if (static_cast<uint64_t>(range.begin) + range.size >
+        flat.stmtLists.size()) {
+      valid = false;
+      return list;
+    }
+
+    for (uint32_t i = 0; i < range.size && valid; ++i)
+      list.emplace_back(raiseRef<T>(flat.stmtLists[range.begin + i]));
+    return list;
+  }
+
+  ASTPtr<Block> raiseBlock(NodeIdx idx) {
+    const flat::Block *block = getNode(flat.blocks, idx);
+    if (!block)
+      return nullptr;
+
+    return ctx.create<Block>(raiseLocation(block->location),
+                             raiseList<Stmt>(block->statements));
+  }
+
+  ASTPtr<Block> raiseOptionalBlock(NodeIdx idx) {
+    return idx == InvalidIdx ? nullptr : raiseBlock(idx);
+  }
+
+  ASTPtr<VarDecl> raiseVarDecl(NodeIdx idx) {
+    const flat::VarDecl *decl = getNode(flat.varDecls, idx);
+    if (!decl)
+      return nullptr;
+
+    std::optional<Type> type;
+    if (decl->type.name != InvalidIdx)
+      type = raiseType(decl->type);
+
+    return ctx.create<VarDecl>(raiseLocation(decl->location),
+                               raiseName(decl->identifier), std::move(type),
+                               raiseFlag(decl->isMutable),
+                               raiseOptionalExpr(decl->initializer));
+  }
+
+  ASTPtr<Stmt> raiseStmt(StmtRef ref) {
+    NodeIdx idx = ref.getIndex();
+
+    switch (ref.getKind()) {
+    case Stmt::Kind::IfStmt: {
+      const flat::IfStmt *stmt = getNode(flat.ifStmts, idx);
+      if (!stmt)
+        return nullptr;
+
+      return ctx.create<IfStmt>(raiseLocation(stmt->location),
+                                raiseRef<Expr>(stmt->condition),
+                                raiseBlock(stmt->trueBlock),
+                                raiseOptionalBlock(stmt->falseBlock));
+    }
+    case Stmt::Kind::WhileStmt: {
+      const flat::WhileStmt *stmt = getNode(flat.whileStmts, idx);
+      if (!stmt)
+        return nullptr;
+
+      return ctx.create<WhileStmt>(raiseLocation(stmt->location),
+                                   raiseRef<Expr>(stmt->condition),
+                                   raiseBlock(stmt->body));
+    }
+    case Stmt::Kind::ReturnStmt: {
+      const flat::ReturnStmt *stmt = getNode(flat.returnStmts, idx);
+      if (!stmt)
+        return nullptr;
+
+      return ctx.create<ReturnStmt>(raiseLocation(stmt->location),
+                                    raiseOptionalExpr(stmt->expr));
+    }
+    case Stmt::Kind::BreakStmt: {
+      const flat::BreakStmt *stmt = getNode(flat.breakStmts, idx);
+      if (!stmt)
+        return nullptr;
+
+      return ctx.create<BreakStmt>(raiseLocation(stmt->location));
+    }
+    case Stmt::Kind::ContinueStmt: {
+      const flat::ContinueStmt *stmt = getNode(flat.continueStmts, idx);
+      if (!stmt)
+        return nullptr;
+
+      return ctx.create<ContinueStmt>(raiseLocation(stmt->location));
+    }
+    case Stmt::Kind::DeclStmt: {
+      const flat::DeclStmt *stmt = getNode(flat.declStmts, idx);
+      if (!stmt)
+        return nullptr;
+
+      ASTPtr<VarDecl> varDecl = raiseVarDecl(stmt->varDecl);
+      if (!varDecl)
+        return nullptr;
+
+      return ctx.create<DeclStmt>(raiseLocation(stmt->location),
+                                  std::move(varDecl));
+    }
+    case Stmt::Kind::Assignment: {
+      const flat::Assignment *stmt = getNode(flat.assignments, idx);
+      if (!stmt)
+        return nullptr;
+
+      return ctx.create<Assignment>(raiseLocation(stmt->location),
+                                    raiseRef<DeclRefExpr>(stmt->variable),
+                                    raiseRef<Expr>(stmt->expr));
+    }
+    case Stmt::Kind::NumberLiteral: {
+      const flat::NumberLiteral *expr = getNode(flat.numberLiterals, idx);
+      if (!expr)
+        return nullptr;
+
+      return ctx.create<NumberLiteral>(raiseLocation(expr->location),
+                                       expr->value);
+    }
+    case Stmt::Kind::DeclRefExpr: {
+      const flat::DeclRefExpr *expr = getNode(flat.declRefExprs, idx);
+      if (!expr)
+        return nullptr;
+
+      return ctx.create<DeclRefExpr>(raiseLocation(expr->location),
+                                     raiseName(expr->identifier));
+    }
+    case Stmt::Kind::CallExpr: {
+      const flat::CallExpr *expr = getNode(flat.callExprs, idx);
+      if (!expr)
+        return nullptr;
+
+      return ctx.create<CallExpr>(raiseLocation(expr->location),
+                                  raiseRef<Expr>(expr->callee),
+                                  raiseList<Expr>(expr->arguments));
+    }
+    case Stmt::Kind::GroupingExpr: {
+      const flat::GroupingExpr *expr = getNode(flat.groupingExprs, idx);
+      if (!expr)
+        return nullptr;
+
+      return ctx.create<GroupingExpr>(raiseLocation(expr->location),
+                                      raiseRef<Expr>(expr->expr));
+    }
+    case Stmt::Kind::BinaryOperator: {
+      const flat::BinaryOperator *expr = getNode(flat.binaryOperators, idx);
+      if (!expr)
+        return nullptr;
+
+      return ctx.create<BinaryOperator>(raiseLocation(expr->location),
+                                        raiseRef<Expr>(expr->lhs),
+                                        raiseRef<Expr>(expr->rhs),
+                                        raiseBinaryOperator(expr->op));
+    }
+    case Stmt::Kind::UnaryOperator: {
+      const flat::UnaryOperator *expr = getNode(flat.unaryOperators, idx);
+      if (!expr)
+        return nullptr;
+
+      return ctx.create<UnaryOperator>(raiseLocation(expr->location),
+                                       raiseUnaryOperator(expr->op),
+                                       raiseRef<Expr>(expr->operand));
+    }
+    case Stmt::Kind::ReadRegisterExpr: {
+      const flat::ReadRegisterExpr *expr =
+          getNode(flat.readRegisterExprs, idx);
+      if (!expr)
+        return nullptr;
+
+      return ctx.create<ReadRegisterExpr>(raiseLocation(expr->location),
+                                          raiseName(expr->address).str());
+    }
+    case Stmt::Kind::LogExpr: {
+      const flat::LogExpr *expr = getNode(flat.logExprs, idx);
+      if (!expr)
+        return nullptr;
+
+      return ctx.create<LogExpr>(raiseLocation(expr->location),
+                                 raiseRef<Expr>(expr->expr));
+    }
+    }
+
+    valid = false;
+    return nullptr;
+  }
+
+public:
+  FlatASTRaiser(const FlatAST &flat,
+                ASTContext &ctx,
+                const SourceFile &source,
+                size_t nodeCount)
+      : flat(flat),
+        ctx(ctx),
+        source(source),
+        remainingNodes(nodeCount) {}
+
+  std::optional<std::vector<ASTPtr<FunctionDecl>>> raise() {
+    std::vector<ASTPtr<FunctionDecl>> functions;
+
+    for (const flat::FunctionDecl &fn : flat.functionDecls) {
+      if (static_cast<uint64_t>(fn.params.begin) + fn.params.size >
+          flat.paramDecls.size())
+        return std::nullopt;
+
+      std::vector<ASTPtr<ParamDecl>> params;
+      for (uint32_t i = 0; i < fn.params.size; ++i) {
+        const flat::ParamDecl &param = flat.paramDecls[fn.params.begin + i];
+        params.emplace_back(ctx.create<ParamDecl>(
+            raiseLocation(param.location), raiseName(param.identifier),
+            raiseType(param.type)));
+      }
+
+      functions.emplace_back(ctx.create<FunctionDecl>(
+          raiseLocation(fn.location), raiseName(fn.identifier),
+          raiseType(fn.type), std::move(params), raiseOptionalBlock(fn.body)));
+
+      if (!valid)
+        return std::nullopt;
+    }
+
+    return functions;
+  }
+};
+} // namespace
+
+std::optional<FlatAST>
+FlatAST::lower(const std::vector<ASTPtr<FunctionDecl>> &ast,
+               const SourceFile &source) {
+  llvm::TimeTraceScope timeScope("FlatAST::lower");
+
+  FlatAST flat;
+  FlatASTBuilder builder(flat, source);
+  for (auto &&fn : ast)
+    builder.lowerFunctionDecl(*fn);
+
+  if (builder.tooManyStmts)
+    return std::nullopt;
+
+  return flat;
+}
+
+std::optional<std::vector<ASTPtr<FunctionDecl>>>
+FlatAST::raise(ASTContext &ctx, const SourceFile &source) const {
+  llvm::TimeTraceScope timeScope("FlatAST::raise");
+
+  size_t nodeCount = 0;
+  forEachArray(*this, [&](const auto &array) { nodeCount += array.size(); });
+
+  return FlatASTRaiser(*this, ctx, source, nodeCount).raise();
+}
+
+void FlatAST::write(llvm::raw_ostream &os) const {
+  os.write(blobMagic, sizeof(blobMagic));
+  os.write(reinterpret_cast<const char *>(&blobVersion), sizeof(blobVersion));
+
+  forEachArray(*this, [&](const auto &array) {
+    auto size = static_cast<uint64_t>(array.size());
+    os.write(reinterpret_cast<const char *>(&size), sizeof(size));
+  });
+
+  forEachArray(*this, [&](const auto &array) {
+    size_t bytes = array.size() * sizeof(array[0]);
+    os.write(reinterpret_cast<const char *>(array.data()), bytes);
+    os.write_zeros(alignToBlob(bytes) - bytes);
+  });
+}
+
+// Only the layout of the blob is validated here. The indices and values in
+// the nodes are checked by raise().
+std::optional<FlatAST> FlatAST::read(llvm::StringRef blob) {
+  const char *ptr = blob.data();
+  const char *end = blob.data() + blob.size();
+
+  auto readBytes = [&](void *dst, size_t bytes) {
+    if (static_cast<size_t>(end - ptr) < bytes)
+      return false;
+
+    if (bytes)
+      std::memcpy(dst, ptr, bytes);
+    ptr += bytes;
+    return true;
+  };
+
+  char magic[sizeof(blobMagic)];
+  uint32_t version;
+  if (!readBytes(magic, sizeof(magic)) ||
+      std::memcmp(magic, blobMagic, sizeof(magic)) != 0 ||
+      !readBytes(&version, sizeof(version)) || version != blobVersion)
+    return std::nullopt;
+
+  FlatAST flat;
+  bool valid = true;
+
+  forEachArray(flat, [&](auto &array) {
+    uint64_t size;
+    if (!valid || !readBytes(&size, sizeof(size)) ||
+        size > static_cast<size_t>(end - ptr) / sizeof(array[0])) {
+      valid = false;
+      return;
+    }
+
+    array.resize(size);
+  });
+
+  forEachArray(flat, [&](auto &array) {
+    size_t bytes = array.size() * sizeof(array[0]);
+    if (!valid || !readBytes(array.data(), bytes)) {
+      valid = false;
+      return;
+    }
+
+    ptr += std::min<size_t>(alignToBlob(bytes) - bytes, end - ptr);
+  });
+
+  if (!valid || (!flat.nameChars.empty() && flat.nameChars.back() != '\0'))
+    return std::nullopt;
+
+  for (uint32_t offset : flat.nameOffsets)
+    if (offset >= flat.nameChars.size())
+      return std::nullopt;
+
+  return flat;
+}
+
+} // namespace syscall
@@ -1,103 +1,455 @@
+#include <llvm/Support/ThreadPool.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SYSCALL_LEXER_X86_SIMD
+#include <immintrin.h>
+#endif
+
 #include "lexer.h"
 
 namespace {
-bool isSpace(char c) {
-    return c == ' ' || c == '\f' || c == '\n' || c == '\r' || c == '\t' || c == '\v';
+enum class CharClass : uint8_t {
+    Other,
+    Space,
+    SingleCharToken,
+    IdentifierStart,
+    Digit,
+    Slash,
+    Equal,
+    Amp,
+    Pipe
+};
+
+constexpr std::array<CharClass, 256> makeCharClassTable() {
+    std::array<CharClass, 256> table{};
+
+    for (unsigned char c : {' ', '\f', '\n', '\r', '\t', '\v'})
+        table[c] = CharClass::Space;
+
+    for (int c = 'a'; c <= 'z'; ++c)
+        table[c] = CharClass::IdentifierStart;
+    for (int c = 'A'; c <= 'Z'; ++c)
+        table[c] = CharClass::IdentifierStart;
+    table['@'] = CharClass::IdentifierStart; // @ indicates a function in Syscall
+
+    for (int c = '0'; c <= '9'; ++c)
+        table[c] = CharClass::Digit;
+
+    table['/'] = CharClass::Slash;
+    table['='] = CharClass::Equal;
+    table['&'] = CharClass::Amp;
+    table['|'] = CharClass::Pipe;
+
+    // Single character tokens take precedence over everything else, just like
+    // they did when they were matched first.
+    for (char c : syscall::singleCharTokens)
+        table[static_cast<unsigned char>(c)] = CharClass::SingleCharToken;
+
+    return table;
+}
+
+constexpr std::array<bool, 256> makeIdentifierBodyTable() {
+    std::array<bool, 256> table{};
+
+    for (int c = 'a'; c <= 'z'; ++c)
+        table[c] = true;
+    for (int c = 'A'; c <= 'Z'; ++c)
+        table[c] = true;
+    for (int c = '0'; c <= '9'; ++c)
+        table[c] = true;
+    table['_'] = true;
+
+    return table;
+}
+
+constexpr std::array<CharClass, 256> charClasses = makeCharClassTable();
+constexpr std::array<bool, 256> identifierBodyChars = makeIdentifierBodyTable();
+
+CharClass getCharClass(char c) {
+    return charClasses[static_cast<unsigned char>(c)];
+}
+
+bool isSpace(char c) { return getCharClass(c) == CharClass::Space; }
+
+bool isNum(char c) { return getCharClass(c) == CharClass::Digit; }
+
+bool isIdentifierBody(char c) {
+    return identifierBodyChars[static_cast<unsigned char>(c)];
+}
+
+// Scanning kernels. Each matcher describes the bytes that continue a run, and
+// scan<Matcher> returns a pointer to the first byte in [p, end) that doesn't.
+// The vector variants only load whole vectors that lie inside [p, end) and
+// finish the tail with the scalar loop.
+struct SpaceMatcher {
+    static bool scalar(char c) { return isSpace(c); }
+};
+
+struct CommentBodyMatcher {
+    static bool scalar(char c) { return c != '\n' && c != '\0'; }
+};
+
+struct IdentifierBodyMatcher {
+    static bool scalar(char c) { return isIdentifierBody(c); }
+};
+
+struct DigitMatcher {
+    static bool scalar(char c) { return isNum(c); }
+};
+
+template <typename Matcher>
+const char *scanScalar(const char *p, const char *end) {
+    while (p != end && Matcher::scalar(*p))
+        ++p;
+    return p;
+}
+
+#ifdef SYSCALL_LEXER_X86_SIMD
+// Lanes of v whose unsigned value is in [lo, hi] are set to all ones.
+__attribute__((target("sse2"))) __m128i inRange(__m128i v, char lo, char hi) {
+    __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    __m128i limit = _mm_set1_epi8(static_cast<char>(hi - lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, limit), offset);
+}
+
+__attribute__((target("avx2"))) __m256i inRange(__m256i v, char lo, char hi) {
+    __m256i offset = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    __m256i limit = _mm256_set1_epi8(static_cast<char>(hi - lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, limit), offset);
+}
+
+struct SpaceVectorMatcher : SpaceMatcher {
+    // ' ' or one of '\t', '\n', '\v', '\f', '\r'.
+    __attribute__((target("sse2"))) static __m128i sse2(__m128i v) {
+        return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                            inRange(v, '\t', '\r'));
+    }
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i v) {
+        return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                               inRange(v, '\t', '\r'));
+    }
+};
+
+struct CommentBodyVectorMatcher : CommentBodyMatcher {
+    __attribute__((target("sse2"))) static __m128i sse2(__m128i v) {
+        __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                    _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        return _mm_cmpeq_epi8(stop, _mm_setzero_si128());
+    }
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i v) {
+        __m256i stop =
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                            _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        return _mm256_cmpeq_epi8(stop, _mm256_setzero_si256());
+    }
+};
+
+struct IdentifierBodyVectorMatcher : IdentifierBodyMatcher {
+    // Setting bit 5 folds 'A'-'Z' onto 'a'-'z' without creating new letters.
+    __attribute__((target("sse2"))) static __m128i sse2(__m128i v) {
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        return _mm_or_si128(
+            _mm_or_si128(inRange(lower, 'a', 'z'), inRange(v, '0', '9')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    }
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i v) {
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        return _mm256_or_si256(
+            _mm256_or_si256(inRange(lower, 'a', 'z'), inRange(v, '0', '9')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+    }
+};
+
+struct DigitVectorMatcher : DigitMatcher {
+    __attribute__((target("sse2"))) static __m128i sse2(__m128i v) {
+        return inRange(v, '0', '9');
+    }
+    __attribute__((target("avx2"))) static __m256i avx2(__m256i v) {
+        return inRange(v, '0', '9');
+    }
+};
+
+template <typename Matcher>
+__attribute__((target("sse2"))) const char *scanSSE2(const char *p,
+                                                     const char *end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned stop = ~_mm_movemask_epi8(Matcher::sse2(v)) & 0xffffu;
+        if (stop)
+            return p + __builtin_ctz(stop);
+    }
+    return scanScalar<Matcher>(p, end);
 }
 
-bool isAlpha(char c) {
-    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
+template <typename Matcher>
+__attribute__((target("avx2"))) const char *scanAVX2(const char *p,
+                                                     const char *end) {
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned stop = ~static_cast<unsigned>(
+            _mm256_movemask_epi8(Matcher::avx2(v)));
+        if (stop)
+            return p + __builtin_ctz(stop);
+    }
+    return scanSSE2<Matcher>(p, end);
 }
 
-bool isNum(char c) { 
-    return '0' <= c && c <= '9'; 
+#endif
+
+struct ScanKernels {
+    using ScanFn = const char *(*)(const char *, const char *);
+
+    ScanFn skipSpace;
+    ScanFn skipCommentBody;
+    ScanFn skipIdentifierBody;
+    ScanFn skipDigits;
+};
+
+ScanKernels selectScanKernels() {
+#ifdef SYSCALL_LEXER_X86_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return {scanAVX2<SpaceVectorMatcher>,
+                scanAVX2<CommentBodyVectorMatcher>,
+                scanAVX2<IdentifierBodyVectorMatcher>,
+                scanAVX2<DigitVectorMatcher>};
+
+    if (__builtin_cpu_supports("sse2"))
+        return {scanSSE2<SpaceVectorMatcher>,
+                scanSSE2<CommentBodyVectorMatcher>,
+                scanSSE2<IdentifierBodyVectorMatcher>,
+                scanSSE2<DigitVectorMatcher>};
+#endif
+
+    return {scanScalar<SpaceMatcher>, scanScalar<CommentBodyMatcher>,
+            scanScalar<IdentifierBodyMatcher>, scanScalar<DigitMatcher>};
 }
 
-bool isAlnum(char c) { 
-    return isAlpha(c) || isNum(c); 
+// Picked on first use rather than by a static initializer, so that nothing
+// runs before main and the CPU checks are only done by processes that lex.
+const ScanKernels &getScanKernels() {
+    static const ScanKernels kernels = selectScanKernels();
+    return kernels;
 }
 } // namespace
 
 namespace syscall {
 
-Token Lexer::getNextToken() {
-    char currentChar = eatNextChar();
+template <typename Matcher> void Lexer::skipRun(ScanFn scan) {
+    const char *begin = source->buffer.data() + idx;
+    const char *end = source->buffer.data() + endIdx;
 
-    while (isSpace(currentChar))
-        currentChar = eatNextChar();
+    // Most runs, especially the whitespace between tokens, are only a byte or
+    // two long, so check the first few bytes inline before paying for the call
+    // into the vector kernel.
+    const char *p = begin;
+    for (const char *shortEnd = begin + std::min<ptrdiff_t>(end - begin, 16);
+         p != shortEnd; ++p) {
+        if (!Matcher::scalar(*p)) {
+            idx = p - source->buffer.data();
+            return;
+        }
+    }
 
-    SourceLocation tokenStartLocation{source->path, line, column};
+    idx = scan(p, end) - source->buffer.data();
+}
 
-    // Single character tokens
-    for (char c : singleCharTokens) {
-        if (c == currentChar)
-            return Token{tokenStartLocation, static_cast<TokenKind>(c)};
+Token Lexer::getNextToken() {
+    const ScanKernels &scanKernels = getScanKernels();
+    skipRun<SpaceMatcher>(scanKernels.skipSpace);
+
+    // Only the end of the whole buffer is followed by a NUL sentinel.
+    if (isAtEnd()) {
+        tokenStart = idx;
+        return Token{source->getLocation(idx), TokenKind::Eof};
     }
 
-    // Comments
-    if (currentChar == '/') {
+    char currentChar = eatNextChar();
+    tokenStart = idx - 1;
+    SourceLocation tokenStartLocation = source->getLocation(tokenStart);
+
+    switch (getCharClass(currentChar)) {
+    case CharClass::SingleCharToken:
+        return Token{tokenStartLocation, static_cast<TokenKind>(currentChar)};
+
+    case CharClass::Slash:
+        // Comments
         if (peekNextChar() == '/') {
             // Skip the rest of the line
-            while (peekNextChar() != '\n' && peekNextChar() != '\0')
-                eatNextChar();
+            skipRun<CommentBodyMatcher>(scanKernels.skipCommentBody);
             return getNextToken(); // Continue with the next token
-        } else {
-            return Token{tokenStartLocation, TokenKind::Slash};
         }
-    }
 
-    // Operators
-    if (currentChar == '=') {
-        if (peekNextChar() == '=')
+        return Token{tokenStartLocation, TokenKind::Slash};
+
+    case CharClass::Equal:
+        if (peekNextChar() == '=') {
+            eatNextChar(); // Consume the second '='
             return Token{tokenStartLocation, TokenKind::EqualEqual};
-        else
-            return Token{tokenStartLocation, TokenKind::Equal};
-    }
+        }
 
-    if (currentChar == '&') {
-        if (peekNextChar() == '&')
+        return Token{tokenStartLocation, TokenKind::Equal};
+
+    case CharClass::Amp:
+        if (peekNextChar() == '&') {
+            eatNextChar(); // Consume the second '&'
             return Token{tokenStartLocation, TokenKind::AmpAmp};
-    }
+        }
+        break;
 
-    if (currentChar == '|') {
-        if (peekNextChar() == '|')
+    case CharClass::Pipe:
+        if (peekNextChar() == '|') {
+            eatNextChar(); // Consume the second '|'
             return Token{tokenStartLocation, TokenKind::PipePipe};
-    }
-
-    // Identifiers and keywords
-    if (isAlpha(currentChar) || currentChar == '@') { // @ indicates a function in Syscall
-        std::string value{currentChar};
+        }
+        break;
 
-        while (isAlnum(peekNextChar()) || peekNextChar() == '_')
-            value += eatNextChar();
+    case CharClass::IdentifierStart: {
+        // Identifiers and keywords
+        size_t start = idx - 1;
+        skipRun<IdentifierBodyMatcher>(
+            scanKernels.skipIdentifierBody);
+        std::string_view value = source->buffer.substr(start, idx - start);
 
-        if (keywords.count(value))
-            return Token{tokenStartLocation, keywords.at(value), std::move(value)};
+        if (std::optional<TokenKind> keyword = keywords.lookup(value))
+            return Token{tokenStartLocation, *keyword, value};
 
-        return Token{tokenStartLocation, TokenKind::Identifier, std::move(value)};
+        return Token{tokenStartLocation, TokenKind::Identifier, value};
     }
 
-    // Numeric literals
-    if (isNum(currentChar)) {
-        std::string value{currentChar};
-
-        while (isNum(peekNextChar()))
-            value += eatNextChar();
+    case CharClass::Digit: {
+        // Numeric literals
+        size_t start = idx - 1;
+        skipRun<DigitMatcher>(scanKernels.skipDigits);
 
         if (peekNextChar() == '.') {
-            value += eatNextChar(); // Consume '.'
-            if (isNum(peekNextChar())) {
-                while (isNum(peekNextChar()))
-                    value += eatNextChar();
-            } else {
+            eatNextChar(); // Consume '.'
+            if (!isNum(peekNextChar()))
                 return Token{tokenStartLocation, TokenKind::Unk}; // Invalid number
-            }
+
+            skipRun<DigitMatcher>(scanKernels.skipDigits);
         }
 
-        return Token{tokenStartLocation, TokenKind::Number, value};
+        return Token{tokenStartLocation, TokenKind::Number,
+                     source->buffer.substr(start, idx - start)};
+    }
+
+    case CharClass::Space:
+    case CharClass::Other:
+        break;
     }
 
     // Handle unexpected characters
     return Token{tokenStartLocation, TokenKind::Unk};
 }
+
+void TokenStream::lexRange(size_t begin, size_t end) {
+    // Tokens are a few bytes long on average, so this avoids most regrowth.
+    size_t expectedTokens = (end - begin) / 4 + 1;
+    kinds.reserve(kinds.size() + expectedTokens);
+    offsets.reserve(offsets.size() + expectedTokens);
+    lengths.reserve(lengths.size() + expectedTokens);
+
+    Lexer lexer(*source, begin, end);
+    TokenKind kind;
+    do {
+        kind = lexer.getNextToken().kind;
+        kinds.emplace_back(kind);
+        offsets.emplace_back(lexer.getTokenStart());
+        lengths.emplace_back(lexer.getTokenEnd() - lexer.getTokenStart());
+    } while (kind != TokenKind::Eof);
+}
+
+TokenStream TokenStream::lex(const SourceFile &source, unsigned threads) {
+    assert(source.buffer.size() <= UINT32_MAX &&
+           "source file too large for 32-bit token offsets");
+
+    // Smaller chunks aren't worth the cost of a thread.
+    constexpr size_t minChunkSize = 1 << 20;
+
+    std::string_view buffer = source.buffer;
+    size_t chunkCount =
+        std::clamp<size_t>(buffer.size() / minChunkSize, 1, std::max(threads, 1u));
+
+    // Every chunk but the last ends right after a newline. Line comments and
+    // tokens never contain a newline, so a chunk can't start in the middle of
+    // either and each one can be lexed without knowing what precedes it.
+    std::vector<size_t> bounds{0};
+    for (size_t i = 1; i < chunkCount; ++i) {
+        size_t newline = buffer.find('\n', std::max(buffer.size() / chunkCount * i,
+                                                     bounds.back()));
+        if (newline == std::string_view::npos || newline + 1 >= buffer.size())
+            break;
+        bounds.emplace_back(newline + 1);
+    }
+    bounds.emplace_back(buffer.size());
+
+    TokenStream stream(source);
+    if (bounds.size() == 2) {
+        stream.lexRange(0, buffer.size());
+        return stream;
+    }
+
+    std::vector<TokenStream> chunks(bounds.size() - 1, TokenStream(source));
+    {
+        llvm::ThreadPool pool(llvm::hardware_concurrency(chunks.size()));
+        for (size_t i = 0; i < chunks.size(); ++i)
+            pool.async([&, i] { chunks[i].lexRange(bounds[i], bounds[i + 1]); });
+    }
+
+    size_t tokenCount = 0;
+    for (const TokenStream &chunk : chunks)
+        tokenCount += chunk.size();
+    stream.kinds.reserve(tokenCount);
+    stream.offsets.reserve(tokenCount);
+    stream.lengths.reserve(tokenCount);
+
+    // Drop the Eof that ends each chunk, unless it is the real end of the
+    // file or comes from a NUL byte inside the chunk, where the serial lexer
+    // would have stopped too.
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        TokenStream &chunk = chunks[i];
+        bool stopsEarly = chunk.offsets.back() != bounds[i + 1];
+        bool isLast = i + 1 == chunks.size() || stopsEarly;
+        size_t count = isLast ? chunk.size() : chunk.size() - 1;
+
+        stream.kinds.insert(stream.kinds.end(), chunk.kinds.begin(),
+                            chunk.kinds.begin() + count);
+        stream.offsets.insert(stream.offsets.end(), chunk.offsets.begin(),
+                              chunk.offsets.begin() + count);
+        stream.lengths.insert(stream.lengths.end(), chunk.lengths.begin(),
+                              chunk.lengths.begin() + count);
+
+        if (isLast)
+            break;
+    }
+
+    return stream;
+}
+
+std::string_view TokenStream::getSpelling(size_t i) const {
+    i = std::min(i, kinds.size() - 1);
+    return source->buffer.substr(offsets[i], lengths[i]);
+}
+
+SourceLocation TokenStream::getLocation(size_t i) const {
+    return source->getLocation(offsets[std::min(i, kinds.size() - 1)]);
+}
+
+Token TokenStream::getToken(size_t i) const {
+    TokenKind kind = getKind(i);
+    Token token{getLocation(i), kind};
+
+    if (kind == TokenKind::Identifier || kind == TokenKind::Number ||
+        (kind >= TokenKind::KwFunction && kind <= TokenKind::KwLog))
+        token.value = getSpelling(i);
+
+    return token;
+}
 } // namespace syscall
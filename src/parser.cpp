@@ -1,7 +1,9 @@
 #include <cassert>
+#include <charconv>
 #include <memory>
 #include <vector>
 #include <optional>
+#include <string_view>
 
 #include "parser.h"
 #include "utils.h"
@@ -35,6 +37,18 @@ int getTokPrecedence(TokenKind tok) {
   }
 }
 
+// Decodes a number token straight from its spelling in the source buffer.
+std::optional<double> parseNumber(std::string_view spelling) {
+  double value;
+  const char *end = spelling.data() + spelling.size();
+  auto [ptr, ec] = std::from_chars(spelling.data(), end, value);
+
+  if (ec != std::errc() || ptr != end)
+    return std::nullopt;
+
+  return value;
+}
+
 }; // namespace
 
 void Parser::synchronize() {
@@ -66,14 +80,14 @@ void Parser::synchronize() {
   }
 }
 
-std::unique_ptr<FunctionDecl> Parser::parseFunctionDecl() {
+ASTPtr<FunctionDecl> Parser::parseFunctionDecl() {
   SourceLocation location = nextToken.location;
   eatNextToken(); // eat function
 
   matchOrReturn(TokenKind::Identifier, "expected identifier");
 
   assert(nextToken.value && "identifier token without value");
-  std::string functionIdentifier = *nextToken.value;
+  Symbol functionIdentifier = astContext->intern(*nextToken.value);
   eatNextToken(); // eat identifier
 
   varOrReturn(parameterList, parseParameterList());
@@ -84,18 +98,63 @@ std::unique_ptr<FunctionDecl> Parser::parseFunctionDecl() {
   varOrReturn(type, parseType());
 
   matchOrReturn(TokenKind::Lbrace, "expected function body");
-  varOrReturn(block, parseBlock());
 
-  return std::make_unique<FunctionDecl>(location, functionIdentifier, *type,
-                                        std::move(*parameterList),
-                                        std::move(block));
+  ASTPtr<Block> block;
+  if (skipFunctionBodies) {
+    if (!skipBlock())
+      return nullptr;
+  } else {
+    block = parseBlock();
+    if (!block)
+      return nullptr;
+  }
+
+  return astContext->create<FunctionDecl>(location, functionIdentifier, *type,
+                                          std::move(*parameterList),
+                                          std::move(block));
+}
+
+ASTPtr<FunctionDecl> Parser::parseFunctionDecl(ASTContext &context) {
+  ASTContext *previousContext = std::exchange(astContext, &context);
+  bool previousIncompleteAST = std::exchange(incompleteAST, false);
+
+  ASTPtr<FunctionDecl> function = parseFunctionDecl();
+  if (incompleteAST)
+    function = nullptr;
+
+  astContext = previousContext;
+  incompleteAST |= previousIncompleteAST;
+  return function;
 }
 
-std::unique_ptr<ParamDecl> Parser::parseParamDecl() {
+std::pair<std::vector<ASTPtr<FunctionDecl>>, bool> Parser::parseSourceFile() {
+  std::vector<ASTPtr<FunctionDecl>> functions;
+
+  while (nextToken.kind != TokenKind::Eof) {
+    if (nextToken.kind != TokenKind::KwFunction) {
+      report(nextToken.location,
+             "only function declarations are allowed on the top level");
+      synchronizeOn(TokenKind::KwFunction);
+      continue;
+    }
+
+    ASTPtr<FunctionDecl> fn = parseFunctionDecl();
+    if (!fn) {
+      synchronizeOn(TokenKind::KwFunction);
+      continue;
+    }
+
+    functions.emplace_back(std::move(fn));
+  }
+
+  return {std::move(functions), !incompleteAST};
+}
+
+ASTPtr<ParamDecl> Parser::parseParamDecl() {
   SourceLocation location = nextToken.location;
   assert(nextToken.value && "identifier token without value");
 
-  std::string identifier = *nextToken.value;
+  Symbol identifier = astContext->intern(*nextToken.value);
   eatNextToken(); // eat identifier
 
   matchOrReturn(TokenKind::Colon, "expected ':'");
@@ -103,16 +162,15 @@ std::unique_ptr<ParamDecl> Parser::parseParamDecl() {
 
   varOrReturn(type, parseType());
 
-  return std::make_unique<ParamDecl>(location, std::move(identifier),
-                                     std::move(*type));
+  return astContext->create<ParamDecl>(location, identifier, std::move(*type));
 }
 
-std::unique_ptr<VarDecl> Parser::parseVarDecl(bool isLet) {
+ASTPtr<VarDecl> Parser::parseVarDecl(bool isLet) {
   SourceLocation location = nextToken.location;
 
   assert(nextToken.value && "identifier token without value");
 
-  std::string identifier = *nextToken.value;
+  Symbol identifier = astContext->intern(*nextToken.value);
   eatNextToken(); // eat identifier
 
   std::optional<Type> type;
@@ -125,20 +183,20 @@ std::unique_ptr<VarDecl> Parser::parseVarDecl(bool isLet) {
   }
 
   if (nextToken.kind != TokenKind::Equal)
-    return std::make_unique<VarDecl>(location, identifier, type, !isLet);
+    return astContext->create<VarDecl>(location, identifier, type, !isLet);
   eatNextToken(); // eat '='
 
   varOrReturn(initializer, parseExpr());
 
-  return std::make_unique<VarDecl>(location, identifier, type, !isLet,
-                                   std::move(initializer));
+  return astContext->create<VarDecl>(location, identifier, type, !isLet,
+                                     std::move(initializer));
 }
 
-std::unique_ptr<Block> Parser::parseBlock() {
+ASTPtr<Block> Parser::parseBlock() {
   SourceLocation location = nextToken.location;
   eatNextToken(); // eat '{'
 
-  std::vector<std::unique_ptr<Stmt>> statements;
+  std::vector<ASTPtr<Stmt>> statements;
   while (true) {
     if (nextToken.kind == TokenKind::Rbrace)
       break;
@@ -146,7 +204,7 @@ std::unique_ptr<Block> Parser::parseBlock() {
     if (nextToken.kind == TokenKind::Eof || nextToken.kind == TokenKind::KwFunction)
       return report(nextToken.location, "expected '}' at the end of a block");
 
-    std::unique_ptr<Stmt> stmt = parseStmt();
+    ASTPtr<Stmt> stmt = parseStmt();
     if (!stmt) {
       synchronize();
       continue;
@@ -157,10 +215,30 @@ std::unique_ptr<Block> Parser::parseBlock() {
 
   eatNextToken(); // eat '}'
 
-  return std::make_unique<Block>(location, std::move(statements));
+  return astContext->create<Block>(location, std::move(statements));
 }
 
-std::unique_ptr<IfStmt> Parser::parseIfStmt() {
+// Skips a block and the blocks nested in it without building any nodes.
+bool Parser::skipBlock() {
+  eatNextToken(); // eat '{'
+
+  for (unsigned depth = 1; depth > 0; eatNextToken()) {
+    if (nextToken.kind == TokenKind::Eof ||
+        nextToken.kind == TokenKind::KwFunction) {
+      report(nextToken.location, "expected '}' at the end of a block");
+      return false;
+    }
+
+    if (nextToken.kind == TokenKind::Lbrace)
+      ++depth;
+    else if (nextToken.kind == TokenKind::Rbrace)
+      --depth;
+  }
+
+  return true;
+}
+
+ASTPtr<IfStmt> Parser::parseIfStmt() {
   SourceLocation location = nextToken.location;
   eatNextToken(); // eat 'if'
 
@@ -171,19 +249,19 @@ std::unique_ptr<IfStmt> Parser::parseIfStmt() {
   varOrReturn(trueBlock, parseBlock());
 
   if (nextToken.kind != TokenKind::KwElse)
-    return std::make_unique<IfStmt>(location, std::move(condition),
-                                    std::move(trueBlock));
+    return astContext->create<IfStmt>(location, std::move(condition),
+                                      std::move(trueBlock));
   eatNextToken(); // eat 'else'
 
-  std::unique_ptr<Block> falseBlock;
+  ASTPtr<Block> falseBlock;
   if (nextToken.kind == TokenKind::KwIf) {
     varOrReturn(elseIf, parseIfStmt());
 
     SourceLocation loc = elseIf->location;
-    std::vector<std::unique_ptr<Stmt>> stmts;
+    std::vector<ASTPtr<Stmt>> stmts;
     stmts.emplace_back(std::move(elseIf));
 
-    falseBlock = std::make_unique<Block>(loc, std::move(stmts));
+    falseBlock = astContext->create<Block>(loc, std::move(stmts));
   } else {
     matchOrReturn(TokenKind::Lbrace, "expected 'else' body");
     falseBlock = parseBlock();
@@ -192,11 +270,11 @@ std::unique_ptr<IfStmt> Parser::parseIfStmt() {
   if (!falseBlock)
     return nullptr;
 
-  return std::make_unique<IfStmt>(location, std::move(condition),
-                                  std::move(trueBlock), std::move(falseBlock));
+  return astContext->create<IfStmt>(location, std::move(condition),
+                                    std::move(trueBlock), std::move(falseBlock));
 }
 
-std::unique_ptr<WhileStmt> Parser::parseWhileStmt() {
+ASTPtr<WhileStmt> Parser::parseWhileStmt() {
   SourceLocation location = nextToken.location;
   eatNextToken(); // eat 'while'
 
@@ -205,21 +283,21 @@ std::unique_ptr<WhileStmt> Parser::parseWhileStmt() {
   matchOrReturn(TokenKind::Lbrace, "expected 'while' body");
   varOrReturn(body, parseBlock());
 
-  return std::make_unique<WhileStmt>(location, std::move(cond),
-                                     std::move(body));
+  return astContext->create<WhileStmt>(location, std::move(cond),
+                                       std::move(body));
 }
 
-std::unique_ptr<Assignment>
-Parser::parseAssignmentRHS(std::unique_ptr<DeclRefExpr> lhs) {
+ASTPtr<Assignment>
+Parser::parseAssignmentRHS(ASTPtr<DeclRefExpr> lhs) {
   SourceLocation location = nextToken.location;
   eatNextToken(); // eat '='
 
   varOrReturn(rhs, parseExpr());
 
-  return std::make_unique<Assignment>(location, std::move(lhs), std::move(rhs));
+  return astContext->create<Assignment>(location, std::move(lhs), std::move(rhs));
 }
 
-std::unique_ptr<DeclStmt> Parser::parseDeclStmt() {
+ASTPtr<DeclStmt> Parser::parseDeclStmt() {
   Token tok = nextToken;
   eatNextToken(); // eat 'let' | 'var'
 
@@ -229,14 +307,14 @@ std::unique_ptr<DeclStmt> Parser::parseDeclStmt() {
   matchOrReturn(TokenKind::Semi, "expected ';' after declaration");
   eatNextToken(); // eat ';'
 
-  return std::make_unique<DeclStmt>(tok.location, std::move(varDecl));
+  return astContext->create<DeclStmt>(tok.location, std::move(varDecl));
 }
 
-std::unique_ptr<ReturnStmt> Parser::parseReturnStmt() {
+ASTPtr<ReturnStmt> Parser::parseReturnStmt() {
   SourceLocation location = nextToken.location;
   eatNextToken(); // eat 'return'
 
-  std::unique_ptr<Expr> expr;
+  ASTPtr<Expr> expr;
   if (nextToken.kind != TokenKind::Semi) {
     expr = parseExpr();
     if (!expr)
@@ -246,10 +324,10 @@ std::unique_ptr<ReturnStmt> Parser::parseReturnStmt() {
   matchOrReturn(TokenKind::Semi, "expected ';' at the end of a return statement");
   eatNextToken(); // eat ';'
 
-  return std::make_unique<ReturnStmt>(location, std::move(expr));
+  return astContext->create<ReturnStmt>(location, std::move(expr));
 }
 
-std::unique_ptr<Stmt> Parser::parseStmt() {
+ASTPtr<Stmt> Parser::parseStmt() {
   if (nextToken.kind == TokenKind::KwIf)
     return parseIfStmt();
 
@@ -265,7 +343,7 @@ std::unique_ptr<Stmt> Parser::parseStmt() {
   return parseAssignmentOrExpr();
 }
 
-std::unique_ptr<Stmt> Parser::parseAssignmentOrExpr() {
+ASTPtr<Stmt> Parser::parseAssignmentOrExpr() {
   varOrReturn(lhs, parsePrefixExpr());
 
   if (nextToken.kind != TokenKind::Equal) {
@@ -277,7 +355,7 @@ std::unique_ptr<Stmt> Parser::parseAssignmentOrExpr() {
     return expr;
   }
 
-  auto *dre = dynamic_cast<DeclRefExpr *>(lhs.get());
+  auto *dre = llvm::dyn_cast<DeclRefExpr>(lhs.get());
   if (!dre)
     return report(lhs->location,
                   "expected variable on the LHS of an assignment");
@@ -285,7 +363,7 @@ std::unique_ptr<Stmt> Parser::parseAssignmentOrExpr() {
   std::ignore = lhs.release();
 
   varOrReturn(assignment,
-              parseAssignmentRHS(std::unique_ptr<DeclRefExpr>(dre)));
+              parseAssignmentRHS(ASTPtr<DeclRefExpr>(dre)));
 
   matchOrReturn(TokenKind::Semi, "expected ';' at the end of assignment");
   eatNextToken(); // eat ';'
@@ -293,11 +371,12 @@ std::unique_ptr<Stmt> Parser::parseAssignmentOrExpr() {
   return assignment;
 }
 
-std::unique_ptr<Expr> Parser::parseExpr() {
-  return parseExprRHS(parsePrefixExpr(), 0);
+ASTPtr<Expr> Parser::parseExpr() {
+  varOrReturn(lhs, parsePrefixExpr());
+  return parseExprRHS(std::move(lhs), 0);
 }
 
-std::unique_ptr<Expr> Parser::parseExprRHS(std::unique_ptr<Expr> lhs, int exprPrec) {
+ASTPtr<Expr> Parser::parseExprRHS(ASTPtr<Expr> lhs, int exprPrec) {
   while (true) {
     int tokPrec = getTokPrecedence(nextToken.kind);
 
@@ -308,7 +387,7 @@ std::unique_ptr<Expr> Parser::parseExprRHS(std::unique_ptr<Expr> lhs, int exprPr
     SourceLocation binOpLoc = nextToken.location;
     eatNextToken(); // eat binary operator
 
-    std::unique_ptr<Expr> rhs = parsePrefixExpr();
+    ASTPtr<Expr> rhs = parsePrefixExpr();
     if (!rhs)
       return nullptr;
 
@@ -319,63 +398,125 @@ std::unique_ptr<Expr> Parser::parseExprRHS(std::unique_ptr<Expr> lhs, int exprPr
         return nullptr;
     }
 
-    lhs = std::make_unique<BinaryExpr>(binOpLoc, binOp, std::move(lhs),
-                                        std::move(rhs));
+    lhs = astContext->create<BinaryOperator>(binOpLoc, std::move(lhs),
+                                             std::move(rhs), binOp);
   }
 }
 
-std::unique_ptr<Expr> Parser::parsePrefixExpr() {
-  TokenKind kind = nextToken.kind;
+ASTPtr<Expr> Parser::parsePrefixExpr() {
+  Token tok = nextToken;
+
+  if (tok.kind != TokenKind::Excl && tok.kind != TokenKind::Minus)
+    return parsePostfixExpr();
+  eatNextToken(); // eat '!' or '-'
+
+  varOrReturn(operand, parsePrefixExpr());
+
+  return astContext->create<UnaryOperator>(tok.location, tok.kind,
+                                           std::move(operand));
+}
+
+ASTPtr<Expr> Parser::parsePostfixExpr() {
+  varOrReturn(expr, parsePrimary());
+
+  if (nextToken.kind != TokenKind::Lpar)
+    return expr;
+
   SourceLocation location = nextToken.location;
+  varOrReturn(argumentList, parseArgumentList());
 
-  if (kind == TokenKind::Identifier) {
-    eatNextToken(); // eat identifier
-    return std::make_unique<DeclRefExpr>(location, *nextToken.value);
-  }
+  return astContext->create<CallExpr>(location, std::move(expr),
+                                      std::move(*argumentList));
+}
 
-  if (kind == TokenKind::IntegerLiteral) {
-    eatNextToken(); // eat integer literal
-    return std::make_unique<IntegerLiteral>(location, *nextToken.value);
-  }
+ASTPtr<Expr> Parser::parsePrimary() {
+  SourceLocation location = nextToken.location;
 
-  if (kind == TokenKind::Lparen) {
+  if (nextToken.kind == TokenKind::Lpar) {
     eatNextToken(); // eat '('
 
     varOrReturn(expr, parseExpr());
 
-    matchOrReturn(TokenKind::Rparen, "expected ')' after expression");
+    matchOrReturn(TokenKind::Rpar, "expected ')'");
     eatNextToken(); // eat ')'
 
-    return expr;
+    return astContext->create<GroupingExpr>(location, std::move(expr));
   }
 
-  return nullptr;
-}
-
-std::unique_ptr<Type> Parser::parseType() {
   if (nextToken.kind == TokenKind::Identifier) {
     assert(nextToken.value && "identifier token without value");
 
-    auto type = std::make_unique<Type>();
-    type->name = *nextToken.value;
+    Symbol identifier = astContext->intern(*nextToken.value);
     eatNextToken(); // eat identifier
+    return astContext->create<DeclRefExpr>(location, identifier);
+  }
+
+  if (nextToken.kind == TokenKind::Number) {
+    assert(nextToken.value && "number token without value");
+
+    std::optional<double> value = parseNumber(*nextToken.value);
+    if (!value)
+      return report(location, "invalid number literal");
 
-    return type;
+    eatNextToken(); // eat number literal
+    return astContext->create<NumberLiteral>(location, *value);
   }
 
-  return nullptr;
+  return report(location, "expected expression");
 }
 
-std::unique_ptr<std::vector<std::unique_ptr<ParamDecl>>>
-Parser::parseParameterList() {
-  SourceLocation location = nextToken.location;
+std::unique_ptr<std::vector<ASTPtr<Expr>>> Parser::parseArgumentList() {
+  matchOrReturn(TokenKind::Lpar, "expected '('");
+  eatNextToken(); // eat '('
+
+  std::vector<ASTPtr<Expr>> argumentList;
+  while (nextToken.kind != TokenKind::Rpar) {
+    varOrReturn(expr, parseExpr());
+    argumentList.emplace_back(std::move(expr));
 
-  matchOrReturn(TokenKind::Lparen, "expected '(' at the start of parameter list");
+    if (nextToken.kind != TokenKind::Comma)
+      break;
+    eatNextToken(); // eat ','
+  }
+
+  matchOrReturn(TokenKind::Rpar, "expected ')'");
+  eatNextToken(); // eat ')'
+
+  return std::make_unique<std::vector<ASTPtr<Expr>>>(std::move(argumentList));
+}
+
+std::optional<Type> Parser::parseType() {
+  TokenKind kind = nextToken.kind;
+
+  if (kind != TokenKind::Identifier) {
+    report(nextToken.location, "expected type specifier");
+    return std::nullopt;
+  }
+
+  assert(nextToken.value && "identifier token without value");
+  std::string_view name = *nextToken.value;
+  eatNextToken(); // eat type
+
+  if (name == "void")
+    return Type::builtinVoid();
+
+  if (name == "number")
+    return Type::builtinNumber();
+
+  // Unknown names are left for Sema to reject.
+  return Type::custom(std::string(name));
+}
+
+std::unique_ptr<std::vector<ASTPtr<ParamDecl>>>
+Parser::parseParameterList() {
+  matchOrReturn(TokenKind::Lpar, "expected '(' at the start of parameter list");
   eatNextToken(); // eat '('
 
-  std::vector<std::unique_ptr<ParamDecl>> params;
-  if (nextToken.kind != TokenKind::Rparen) {
+  std::vector<ASTPtr<ParamDecl>> params;
+  if (nextToken.kind != TokenKind::Rpar) {
     do {
+      matchOrReturn(TokenKind::Identifier, "expected parameter declaration");
+
       varOrReturn(param, parseParamDecl());
       params.emplace_back(std::move(param));
 
@@ -386,10 +527,10 @@ Parser::parseParameterList() {
     } while (true);
   }
 
-  matchOrReturn(TokenKind::Rparen, "expected ')' at the end of parameter list");
+  matchOrReturn(TokenKind::Rpar, "expected ')' at the end of parameter list");
   eatNextToken(); // eat ')'
 
-  return std::make_unique<std::vector<std::unique_ptr<ParamDecl>>>(std::move(params));
+  return std::make_unique<std::vector<ASTPtr<ParamDecl>>>(std::move(params));
 }
 
 } // namespace syscall
@@ -1,14 +1,26 @@
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/TimeProfiler.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <map>
+#include <iostream>
 #include <set>
 
 #include "cfg.h"
+#include "dataflow.h"
 #include "sema.h"
+#include "timer.h"
 #include "utils.h"
 
 namespace syscall {
 
-bool Sema::runFlowSensitiveChecks(const ResolvedFunctionDecl &fn) {
+bool Sema::runFlowSensitiveChecks(const FunctionDecl &fn) {
+    PhaseTimerRAII timer("Flow-sensitive checks");
+    llvm::TimeTraceScope timeScope("Sema::runFlowSensitiveChecks",
+                                  fn.identifier.getName());
+
     CFG cfg = CFGBuilder().build(fn);
 
     bool error = false;
@@ -18,7 +30,7 @@ bool Sema::runFlowSensitiveChecks(const ResolvedFunctionDecl &fn) {
     return error;
 }
 
-bool Sema::checkReturnOnAllPaths(const ResolvedFunctionDecl &fn, const CFG &cfg) {
+bool Sema::checkReturnOnAllPaths(const FunctionDecl &fn, const CFG &cfg) {
     if (fn.type.kind == Type::Kind::Void)
         return false;
 
@@ -40,7 +52,7 @@ bool Sema::checkReturnOnAllPaths(const ResolvedFunctionDecl &fn, const CFG &cfg)
 
         const auto &[preds, succs, stmts] = cfg.basicBlocks[bb];
 
-        if (!stmts.empty() && dynamic_cast<const ResolvedReturnStmt *>(stmts[0])) {
+        if (!stmts.empty() && llvm::isa<ReturnStmt>(stmts[0])) {
             ++returnCount;
             continue;
         }
@@ -61,130 +73,127 @@ bool Sema::checkReturnOnAllPaths(const ResolvedFunctionDecl &fn, const CFG &cfg)
 }
 
 bool Sema::checkVariableInitialization(const CFG &cfg) {
-    enum class State { Bottom, Unassigned, Assigned, Top };
-
-    using Lattice = std::map<const ResolvedVarDecl *, State>;
-
-    auto joinStates = [](State s1, State s2) {
-        if (s1 == s2)
-            return s1;
-
-        if (s1 == State::Bottom)
-            return s2;
-
-        if (s2 == State::Bottom)
-            return s1;
-
-        return State::Top;
+    // Every variable gets a dense index and two bits of state: whether it
+    // may be unassigned and whether it may be assigned on the paths reaching
+    // a statement. Neither bit means that no path has declared it yet, and
+    // the join of two states is the union of their bits.
+    llvm::DenseMap<const VarDecl *, unsigned> varIndices;
+    for (auto &&bb : cfg.basicBlocks)
+        for (auto &&stmt : bb.statements)
+            if (const auto *decl = llvm::dyn_cast<DeclStmt>(stmt))
+                varIndices.try_emplace(decl->varDecl.get(), varIndices.size());
+
+    auto getUnassignedBit = [&](const VarDecl *var) {
+        auto it = varIndices.find(var);
+        assert(it != varIndices.end() && "variable declared outside of the CFG");
+        return 2 * it->second;
     };
 
-    std::vector<Lattice> curLattices(cfg.basicBlocks.size());
-    std::vector<std::pair<SourceLocation, std::string>> pendingErrors;
-
-    bool changed = true;
-    while (changed) {
-        changed = false;
-        pendingErrors.clear();
+    bool error = false;
+    auto transferBlock = [&](int bb, llvm::BitVector &state, bool diagnose) {
+        const auto &stmts = cfg.basicBlocks[bb].statements;
 
-        for (int bb = cfg.entry; bb != cfg.exit; --bb) {
-            const auto &[preds, succs, stmts] = cfg.basicBlocks[bb];
+        for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) {
+            const Stmt *stmt = *it;
 
-            Lattice tmp;
-            for (auto &&pred : preds)
-                for (auto &&[decl, state] : curLattices[pred.first])
-                    tmp[decl] = joinStates(tmp[decl], state);
+            if (auto *decl = llvm::dyn_cast<DeclStmt>(stmt)) {
+                unsigned bit = getUnassignedBit(decl->varDecl.get());
+                state.reset(bit, bit + 2);
+                state.set(decl->varDecl->initializer ? bit + 1 : bit);
+                continue;
+            }
 
-            for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) {
-                const ResolvedStmt *stmt = *it;
+            if (auto *assignment = llvm::dyn_cast<Assignment>(stmt)) {
+                const auto *var =
+                    llvm::dyn_cast<VarDecl>(assignment->variable->decl);
 
-                if (auto *decl = dynamic_cast<const ResolvedDeclStmt *>(stmt)) {
-                    tmp[decl->varDecl.get()] =
-                        decl->varDecl->initializer ? State::Assigned : State::Unassigned;
-                    continue;
-                }
+                assert(var &&
+                       "assignment to non-variables should have been caught by sema");
 
-                if (auto *assignment = dynamic_cast<const ResolvedAssignment *>(stmt)) {
-                    const auto *var =
-                        dynamic_cast<const ResolvedVarDecl *>(assignment->variable->decl);
+                unsigned bit = getUnassignedBit(var);
+                bool isUnassigned = state.test(bit) && !state.test(bit + 1);
 
-                    assert(var &&
-                           "assignment to non-variables should have been caught by sema");
+                if (diagnose && !var->isMutable && !isUnassigned) {
+                    report(assignment->location,
+                           '\'' + var->identifier.str() + "' cannot be mutated");
+                    error = true;
+                }
 
-                    if (!var->isMutable && tmp[var] != State::Unassigned) {
-                        std::string msg = '\'' + var->identifier + "' cannot be mutated";
-                        pendingErrors.emplace_back(assignment->location, std::move(msg));
-                    }
+                state.reset(bit);
+                state.set(bit + 1);
+                continue;
+            }
 
-                    tmp[var] = State::Assigned;
+            if (const auto *dre = llvm::dyn_cast<DeclRefExpr>(stmt)) {
+                const auto *var = llvm::dyn_cast<VarDecl>(dre->decl);
+                if (!var)
                     continue;
-                }
-
-                if (const auto *dre = dynamic_cast<const ResolvedDeclRefExpr *>(stmt)) {
-                    const auto *var = dynamic_cast<const ResolvedVarDecl *>(dre->decl);
 
-                    if (var && tmp[var] != State::Assigned) {
-                        std::string msg = '\'' + var->identifier + "' is not initialized";
-                        pendingErrors.emplace_back(dre->location, std::move(msg));
-                    }
+                unsigned bit = getUnassignedBit(var);
+                bool isAssigned = !state.test(bit) && state.test(bit + 1);
 
-                    continue;
+                if (diagnose && !isAssigned) {
+                    report(dre->location,
+                           '\'' + var->identifier.str() + "' is not initialized");
+                    error = true;
                 }
-            }
 
-            if (curLattices[bb] != tmp) {
-                curLattices[bb] = tmp;
-                changed = true;
+                continue;
             }
         }
-    }
+    };
+
+    std::vector<llvm::BitVector> entryStates = solveForwardDataflow(
+        cfg, 2 * varIndices.size(), [&](int bb, llvm::BitVector &state) {
+            transferBlock(bb, state, false);
+        });
 
-    for (auto &&[loc, msg] : pendingErrors)
-        report(loc, msg);
+    // Only the final states are diagnosed, so every error is reported once.
+    for (int bb = cfg.entry; bb != cfg.exit; --bb)
+        transferBlock(bb, entryStates[bb], true);
 
-    return !pendingErrors.empty();
+    return error;
 }
 
-bool Sema::insertDeclToCurrentScope(ResolvedDecl &decl) {
+bool Sema::insertDeclToCurrentScope(Decl &decl) {
     const auto &[foundDecl, scopeIdx] = lookupDecl(decl.identifier);
 
     if (foundDecl && scopeIdx == 0) {
-        report(decl.location, "redeclaration of '" + decl.identifier + '\'');
+        report(decl.location, "redeclaration of '" + decl.identifier.str() + '\'');
         return false;
     }
 
-    scopes.back().emplace_back(&decl);
+    symbolTable.insert(decl.identifier, {&decl, scopeDepth});
     return true;
 }
 
-std::pair<ResolvedDecl *, int> Sema::lookupDecl(const std::string id) {
-    int scopeIdx = 0;
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-        for (auto &&decl : *it) {
-            if (decl->identifier != id)
-                continue;
-
-            return {decl, scopeIdx};
-        }
+std::pair<Decl *, int> Sema::lookupDecl(Symbol id) {
+    std::pair<Decl *, unsigned> entry = symbolTable.lookup(id);
+    if (!entry.first && parent)
+        entry = parent->symbolTable.lookup(id);
 
-        ++scopeIdx;
-    }
+    auto [decl, depth] = entry;
+    if (!decl)
+        return {nullptr, -1};
 
-    return {nullptr, -1};
+    return {decl, static_cast<int>(scopeDepth - depth)};
 }
 
-std::unique_ptr<ResolvedFunctionDecl> Sema::createBuiltinPrintln() {
-    SourceLocation loc{"<builtin>", 0, 0};
+ASTPtr<FunctionDecl> Sema::createBuiltinPrintln() {
+    // Builtins don't belong to any source file.
+    SourceLocation loc{};
 
-    auto param = std::make_unique<ResolvedParamDecl>(loc, "n", Type::builtinNumber());
+    auto param = astContext->create<ParamDecl>(
+        loc, astContext->intern("n"), Type::builtinNumber());
 
-    std::vector<std::unique_ptr<ResolvedParamDecl>> params;
+    std::vector<ASTPtr<ParamDecl>> params;
     params.emplace_back(std::move(param));
 
-    auto block = std::make_unique<ResolvedBlock>(
-        loc, std::vector<std::unique_ptr<ResolvedStmt>>());
+    auto block = astContext->create<Block>(loc, std::vector<ASTPtr<Stmt>>());
 
-    return std::make_unique<ResolvedFunctionDecl>(
-        loc, "println", Type::builtinVoid(), std::move(params), std::move(block));
+    return astContext->create<FunctionDecl>(
+        loc, astContext->intern("println"), Type::builtinVoid(),
+        std::move(params), std::move(block));
 }
 
 std::optional<Type> Sema::resolveType(Type parsedType) {
@@ -194,152 +203,355 @@ std::optional<Type> Sema::resolveType(Type parsedType) {
     return parsedType;
 }
 
-std::unique_ptr<ResolvedUnaryOperator> Sema::resolveUnaryOperator(const UnaryOperator &unary) {
-    varOrReturn(resolvedRHS, resolveExpr(*unary.operand));
+UnaryOperator *Sema::visitUnaryOperator(UnaryOperator &unary) {
+    varOrReturn(operand, resolveExpr(*unary.operand));
 
-    if (resolvedRHS->type.kind == Type::Kind::Void)
+    if (operand->type.kind == Type::Kind::Void)
         return report(
-            resolvedRHS->location,
+            operand->location,
             "void expression cannot be used as an operand to unary operator");
 
-    return std::make_unique<ResolvedUnaryOperator>(unary.location, unary.op, std::move(resolvedRHS));
+    unary.type = operand->type;
+    return &unary;
 }
 
-std::unique_ptr<ResolvedBinaryOperator> Sema::resolveBinaryOperator(const BinaryOperator &binop) {
-    varOrReturn(resolvedLHS, resolveExpr(*binop.lhs));
-    varOrReturn(resolvedRHS, resolveExpr(*binop.rhs));
+BinaryOperator *Sema::visitBinaryOperator(BinaryOperator &binop) {
+    varOrReturn(lhs, resolveExpr(*binop.lhs));
+    varOrReturn(rhs, resolveExpr(*binop.rhs));
 
-    if (resolvedLHS->type.kind == Type::Kind::Void)
+    if (lhs->type.kind == Type::Kind::Void)
         return report(
-            resolvedLHS->location,
+            lhs->location,
             "void expression cannot be used as LHS operand to binary operator");
 
-    if (resolvedRHS->type.kind == Type::Kind::Void)
+    if (rhs->type.kind == Type::Kind::Void)
         return report(
-            resolvedRHS->location,
+            rhs->location,
             "void expression cannot be used as RHS operand to binary operator");
 
-    assert(resolvedLHS->type.kind == resolvedRHS->type.kind &&
-           resolvedLHS->type.kind == Type::Kind::Number &&
+    assert(lhs->type.kind == rhs->type.kind &&
+           lhs->type.kind == Type::Kind::Number &&
            "unexpected type in binop");
 
-    return std::make_unique<ResolvedBinaryOperator>(
-        binop.location, binop.op, std::move(resolvedLHS), std::move(resolvedRHS));
+    binop.type = lhs->type;
+    return &binop;
 }
 
-std::unique_ptr<ResolvedGroupingExpr> Sema::resolveGroupingExpr(const GroupingExpr &grouping) {
-    varOrReturn(resolvedExpr, resolveExpr(*grouping.expr));
-    return std::make_unique<ResolvedGroupingExpr>(grouping.location, std::move(resolvedExpr));
+GroupingExpr *Sema::visitGroupingExpr(GroupingExpr &grouping) {
+    varOrReturn(expr, resolveExpr(*grouping.expr));
+
+    grouping.type = expr->type;
+    return &grouping;
 }
 
-std::unique_ptr<ResolvedDeclRefExpr> Sema::resolveDeclRefExpr(const DeclRefExpr &declRefExpr, bool isCallee) {
-    ResolvedDecl *decl = lookupDecl(declRefExpr.identifier).first;
+DeclRefExpr *Sema::resolveDeclRefExpr(DeclRefExpr &declRefExpr, bool isCallee) {
+    Decl *decl = lookupDecl(declRefExpr.identifier).first;
     if (!decl)
         return report(declRefExpr.location,
-                      "symbol '" + declRefExpr.identifier + "' not found");
+                      "symbol '" + declRefExpr.identifier.str() + "' not found");
 
-    if (!isCallee && dynamic_cast<ResolvedFunctionDecl *>(decl))
+    if (!isCallee && llvm::isa<FunctionDecl>(decl))
         return report(declRefExpr.location,
-                      "expected to call function '" + declRefExpr.identifier + "'");
+                      "expected to call function '" + declRefExpr.identifier.str() + "'");
 
-    return std::make_unique<ResolvedDeclRefExpr>(declRefExpr.location, *decl);
+    declRefExpr.decl = decl;
+    declRefExpr.type = decl->getType();
+    return &declRefExpr;
 }
 
-std::unique_ptr<ResolvedCallExpr> Sema::resolveCallExpr(const CallExpr &call) {
-    const auto *dre = dynamic_cast<const DeclRefExpr *>(call.callee.get());
+DeclRefExpr *Sema::visitDeclRefExpr(DeclRefExpr &declRefExpr) {
+    return resolveDeclRefExpr(declRefExpr, false);
+}
+
+CallExpr *Sema::visitCallExpr(CallExpr &call) {
+    auto *dre = llvm::dyn_cast<DeclRefExpr>(call.callee.get());
     if (!dre)
         return report(call.location, "expression cannot be called as a function");
 
-    varOrReturn(resolvedCallee, resolveDeclRefExpr(*dre, true));
+    varOrReturn(callee, resolveDeclRefExpr(*dre, true));
 
-    const auto *resolvedFunctionDecl =
-        dynamic_cast<const ResolvedFunctionDecl *>(resolvedCallee->decl);
+    const auto *functionDecl = llvm::dyn_cast<FunctionDecl>(callee->decl);
 
-    if (!resolvedFunctionDecl)
+    if (!functionDecl)
         return report(call.location, "calling non-function symbol");
 
-    if (call.arguments.size() != resolvedFunctionDecl->params.size())
+    if (call.arguments.size() != functionDecl->params.size())
         return report(call.location, "argument count mismatch");
 
-    std::vector<std::unique_ptr<ResolvedExpr>> resolvedArgs;
-    resolvedArgs.reserve(call.arguments.size());
-
     for (auto &&arg : call.arguments) {
         varOrReturn(resolvedArg, resolveExpr(*arg));
-        resolvedArgs.emplace_back(std::move(resolvedArg));
+        resolvedArg->setConstantValue(cee.evaluate(*resolvedArg, false));
     }
 
-    return std::make_unique<ResolvedCallExpr>(call.location, std::move(resolvedCallee), std::move(resolvedArgs));
+    call.calleeDecl = functionDecl;
+    call.type = functionDecl->type;
+    return &call;
 }
 
-std::unique_ptr<ResolvedAssignment> Sema::resolveAssignment(const Assignment &assignment) {
-    auto varExpr = dynamic_cast<DeclRefExpr *>(assignment.variable.get());
-    if (!varExpr)
-        return report(assignment.location, "assignment to non-variable");
+Assignment *Sema::resolveAssignment(Assignment &assignment) {
+    varOrReturn(var, resolveDeclRefExpr(*assignment.variable, false));
+    varOrReturn(value, resolveExpr(*assignment.expr));
 
-    varOrReturn(resolvedVar, resolveDeclRefExpr(*varExpr, false));
-    varOrReturn(resolvedValue, resolveExpr(*assignment.value));
+    const auto *varDecl = llvm::dyn_cast<VarDecl>(var->decl);
+    if (!varDecl)
+        return report(assignment.location, "assignment to non-variable");
 
-    if (resolvedVar->decl->isMutable &&
-        resolvedValue->type.kind != resolvedVar->decl->type.kind)
+    if (varDecl->isMutable && value->type.kind != var->type.kind)
         return report(assignment.location, "incompatible types in assignment");
 
-    return std::make_unique<ResolvedAssignment>(assignment.location, std::move(resolvedVar), std::move(resolvedValue));
+    value->setConstantValue(cee.evaluate(*value, false));
+    return &assignment;
 }
 
-std::unique_ptr<ResolvedReturnStmt> Sema::resolveReturnStmt(const ReturnStmt &returnStmt) {
-    varOrReturn(resolvedValue, resolveExpr(*returnStmt.value));
+ReturnStmt *Sema::resolveReturnStmt(ReturnStmt &returnStmt) {
+    if (!returnStmt.expr)
+        return &returnStmt;
+
+    varOrReturn(value, resolveExpr(*returnStmt.expr));
 
-    if (resolvedValue->type.kind == Type::Kind::Void)
+    if (value->type.kind == Type::Kind::Void)
         return report(returnStmt.location, "void expression cannot be returned");
 
-    return std::make_unique<ResolvedReturnStmt>(returnStmt.location, std::move(resolvedValue));
+    value->setConstantValue(cee.evaluate(*value, false));
+    return &returnStmt;
 }
 
-std::unique_ptr<ResolvedDeclStmt> Sema::resolveDeclStmt(const DeclStmt &declStmt) {
-    if (!resolveType(declStmt.type))
-        return report(declStmt.location, "invalid type");
+VarDecl *Sema::resolveVarDecl(VarDecl &varDecl) {
+    if (varDecl.type && !resolveType(*varDecl.type))
+        return report(varDecl.location, "invalid type");
 
-    if (declStmt.initializer) {
-        varOrReturn(resolvedInitializer, resolveExpr(*declStmt.initializer));
-        if (resolvedInitializer->type.kind != declStmt.type.kind)
-            return report(declStmt.location, "incompatible types in initializer");
+    if (!varDecl.initializer) {
+        if (!varDecl.type)
+            return report(
+                varDecl.location,
+                "an uninitialized variable is expected to have a type");
+
+        return &varDecl;
     }
 
-    auto decl = std::make_unique<ResolvedVarDecl>(declStmt.location, declStmt.identifier, declStmt.type,
-                                                   declStmt.initializer ? true : false);
+    varOrReturn(initializer, resolveExpr(*varDecl.initializer));
+
+    if (initializer->type.kind == Type::Kind::Void)
+        return report(varDecl.location,
+                      "void expression cannot be used as an initializer");
+
+    if (varDecl.type && initializer->type.kind != varDecl.type->kind)
+        return report(varDecl.location, "incompatible types in initializer");
+
+    if (!varDecl.type)
+        varDecl.type = initializer->type;
+
+    initializer->setConstantValue(cee.evaluate(*initializer, false));
+    return &varDecl;
+}
+
+DeclStmt *Sema::resolveDeclStmt(DeclStmt &declStmt) {
+    varOrReturn(varDecl, resolveVarDecl(*declStmt.varDecl));
 
-    if (!insertDeclToCurrentScope(*decl))
+    if (!insertDeclToCurrentScope(*varDecl))
         return nullptr;
 
-    return std::make_unique<ResolvedDeclStmt>(declStmt.location, std::move(decl));
+    return &declStmt;
 }
 
-std::unique_ptr<ResolvedExpr> Sema::resolveExpr(const Expr &expr) {
-    if (const auto *unary = dynamic_cast<const UnaryOperator *>(&expr))
-        return resolveUnaryOperator(*unary);
+IfStmt *Sema::resolveIfStmt(IfStmt &ifStmt) {
+    varOrReturn(condition, resolveExpr(*ifStmt.condition));
+
+    if (condition->type.kind != Type::Kind::Number)
+        return report(condition->location, "expected number in condition");
+
+    condition->setConstantValue(cee.evaluate(*condition, false));
 
-    if (const auto *binop = dynamic_cast<const BinaryOperator *>(&expr))
-        return resolveBinaryOperator(*binop);
+    if (!resolveBlock(*ifStmt.trueBlock))
+        return nullptr;
 
-    if (const auto *grouping = dynamic_cast<const GroupingExpr *>(&expr))
-        return resolveGroupingExpr(*grouping);
+    if (ifStmt.falseBlock && !resolveBlock(*ifStmt.falseBlock))
+        return nullptr;
 
-    if (const auto *declRef = dynamic_cast<const DeclRefExpr *>(&expr))
-        return resolveDeclRefExpr(*declRef, false);
+    return &ifStmt;
+}
 
-    if (const auto *call = dynamic_cast<const CallExpr *>(&expr))
-        return resolveCallExpr(*call);
+WhileStmt *Sema::resolveWhileStmt(WhileStmt &whileStmt) {
+    varOrReturn(condition, resolveExpr(*whileStmt.condition));
 
-    if (const auto *assign = dynamic_cast<const Assignment *>(&expr))
-        return resolveAssignment(*assign);
+    if (condition->type.kind != Type::Kind::Number)
+        return report(condition->location, "expected number in condition");
 
-    assert(false && "unexpected expression type");
-    return nullptr;
+    condition->setConstantValue(cee.evaluate(*condition, false));
+
+    if (!resolveBlock(*whileStmt.body))
+        return nullptr;
+
+    return &whileStmt;
+}
+
+NumberLiteral *Sema::visitNumberLiteral(NumberLiteral &number) {
+    number.type = Type::builtinNumber();
+    return &number;
+}
+
+Expr *Sema::resolveExpr(Expr &expr) {
+    return visit(expr);
+}
+
+Stmt *Sema::resolveStmt(Stmt &stmt) {
+    switch (stmt.getKind()) {
+    case Stmt::Kind::IfStmt:
+        return resolveIfStmt(llvm::cast<IfStmt>(stmt));
+    case Stmt::Kind::WhileStmt:
+        return resolveWhileStmt(llvm::cast<WhileStmt>(stmt));
+    case Stmt::Kind::ReturnStmt:
+        return resolveReturnStmt(llvm::cast<ReturnStmt>(stmt));
+    case Stmt::Kind::BreakStmt:
+    case Stmt::Kind::ContinueStmt:
+        return &stmt;
+    case Stmt::Kind::DeclStmt:
+        return resolveDeclStmt(llvm::cast<DeclStmt>(stmt));
+    case Stmt::Kind::Assignment:
+        return resolveAssignment(llvm::cast<Assignment>(stmt));
+    default:
+        return resolveExpr(llvm::cast<Expr>(stmt));
+    }
+}
+
+Block *Sema::resolveBlock(Block &block) {
+    ScopeRAII blockScope(this);
+
+    // Keep going after an error, so that every statement gets diagnosed.
+    bool error = false;
+    for (auto &&stmt : block.statements)
+        error |= !resolveStmt(*stmt);
+
+    if (error)
+        return nullptr;
+
+    return &block;
+}
+
+ParamDecl *Sema::resolveParamDecl(ParamDecl &param) {
+    std::optional<Type> type = resolveType(param.type);
+    if (!type || type->kind == Type::Kind::Void)
+        return report(param.location, "parameter '" + param.identifier.str() +
+                                          "' has invalid '" + param.type.name +
+                                          "' type");
+
+    return &param;
+}
+
+FunctionDecl *Sema::resolveFunctionDeclaration(FunctionDecl &function) {
+    llvm::TimeTraceScope timeScope("Sema::resolveFunctionDeclaration",
+                                   function.identifier.getName());
+
+    std::optional<Type> type = resolveType(function.type);
+    if (!type)
+        return report(function.location, "function '" +
+                                             function.identifier.str() +
+                                             "' has invalid '" +
+                                             function.type.name + "' type");
+
+    // The program is entered through a wrapper that calls main without
+    // arguments.
+    if (function.identifier.getName() == "main" && !function.params.empty())
+        return report(function.location,
+                      "'main' function is expected to take no arguments");
+
+    // Only checks that the parameter names are unique, the body gets a fresh
+    // scope with the parameters later.
+    ScopeRAII paramScope(this);
+    for (auto &&param : function.params)
+        if (!resolveParamDecl(*param) || !insertDeclToCurrentScope(*param))
+            return nullptr;
+
+    return &function;
+}
+
+bool Sema::resolveFunctionDeclarations() {
+    assert(!globalScope && "the declarations are already resolved");
+
+    globalScope.emplace(this);
+    ast.insert(ast.begin(), createBuiltinPrintln());
+
+    bool error = false;
+    for (auto &&fn : ast)
+        if (!resolveFunctionDeclaration(*fn) || !insertDeclToCurrentScope(*fn))
+            error = true;
+
+    return !error;
+}
+
+bool Sema::resolveFunctionBody(FunctionDecl &fn) {
+    assert((globalScope || parent) &&
+           "the declarations have to be resolved first");
+    assert(fn.body && "resolving a function without a body");
+
+    currentFunction = &fn;
+    llvm::TimeTraceScope timeScope("Sema::resolveFunctionBody",
+                                   fn.identifier.getName());
+
+    ScopeRAII paramScope(this);
+    for (auto &&param : fn.params)
+        insertDeclToCurrentScope(*param);
+
+    if (!resolveBlock(*fn.body))
+        return false;
+
+    return !runFlowSensitiveChecks(fn);
+}
+
+bool Sema::resolveFunctionBodies(
+    llvm::ArrayRef<ASTPtr<FunctionDecl>> functions, unsigned threadCount) {
+    threadCount = std::min<size_t>(threadCount, functions.size());
+
+    if (threadCount <= 1) {
+        bool error = false;
+        for (auto &&fn : functions)
+            error |= !resolveFunctionBody(*fn);
+
+        return !error;
+    }
+
+    // A body only refers to the global scope besides its own declarations,
+    // so the bodies can be resolved independently. Every worker has a scope
+    // stack of its own and takes the next unresolved body when it is done,
+    // and the diagnostics of each body are held back until all are resolved.
+    std::vector<std::string> diagnostics(functions.size());
+    std::vector<char> failed(functions.size());
+    std::atomic<size_t> nextFunction = 0;
+
+    int phaseDepth = getPhaseNestingDepth();
+    llvm::ThreadPool pool(llvm::hardware_concurrency(threadCount));
+    for (unsigned i = 0; i < threadCount; ++i)
+        pool.async([&] {
+            TimeTraceThreadRAII timeTrace("Sema worker");
+            PhaseNestingRAII phaseNesting(phaseDepth);
+            Sema worker(this);
+            for (size_t idx = nextFunction++; idx < functions.size();
+                 idx = nextFunction++) {
+                DiagnosticBufferRAII buffer(diagnostics[idx]);
+                failed[idx] = !worker.resolveFunctionBody(*functions[idx]);
+            }
+        });
+    pool.wait();
+
+    bool error = false;
+    for (size_t idx = 0; idx < functions.size(); ++idx) {
+        std::cerr << diagnostics[idx];
+        error |= failed[idx];
+    }
+
+    return !error;
 }
 
-void Sema::report(SourceLocation location, std::string message) {
-    std::cerr << "Error at " << location.file << ":" << location.line << ": " << message << std::endl;
+std::vector<ASTPtr<FunctionDecl>> Sema::resolveAST(unsigned threadCount) {
+    if (!resolveFunctionDeclarations())
+        return {};
+
+    // The builtin println at the front has no body to resolve.
+    if (!resolveFunctionBodies(llvm::makeArrayRef(ast).drop_front(),
+                               threadCount))
+        return {};
+
+    return std::move(ast);
 }
 
-} // namespace syscall
\ No newline at end of file
+} // namespace syscall
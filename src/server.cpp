@@ -0,0 +1,332 @@
+// <unistd.h> declares a 'syscall' function that clashes with our namespace,
+// so it is renamed while the header is included.
+#define syscall posix_syscall
+#include <unistd.h>
+#undef syscall
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "server.h"
+
+// A request is a 32-bit payload size followed by the payload: the client's
+// working directory and its arguments, each terminated by a NUL byte. The
+// client's stdin, stdout and stderr travel with it as SCM_RIGHTS. The reply
+// is the 32-bit exit code of the compilation.
+
+namespace syscall {
+namespace {
+constexpr int forwardedFdCount = 3;
+
+// Far more than any command line the kernel accepts, but small enough that a
+// bogus size can't make the server allocate gigabytes.
+constexpr uint32_t maxPayloadSize = 16u << 20;
+
+bool writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written == -1 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+
+    data += written;
+    size -= written;
+  }
+
+  return true;
+}
+
+bool readAll(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t received = read(fd, data, size);
+    if (received == -1 && errno == EINTR)
+      continue;
+    if (received <= 0)
+      return false;
+
+    data += received;
+    size -= received;
+  }
+
+  return true;
+}
+
+// The descriptors of the server must not leak into the processes it runs.
+int setCloseOnExec(int fd) {
+  if (fd != -1 && fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+int createSocket() {
+#ifdef __linux__
+  return socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#else
+  return setCloseOnExec(socket(AF_UNIX, SOCK_STREAM, 0));
+#endif
+}
+
+int acceptConnection(int listenFd) {
+#ifdef __linux__
+  return accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+#else
+  return setCloseOnExec(accept(listenFd, nullptr, nullptr));
+#endif
+}
+
+bool makeAddress(const std::string &socketPath, sockaddr_un &addr) {
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+
+  if (socketPath.size() >= sizeof(addr.sun_path))
+    return false;
+
+  std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+  return true;
+}
+
+// A request makes the server compile and write files on behalf of its own
+// user, so only that user may send one.
+bool isPeerTrusted(int conn) {
+#ifdef __linux__
+  ucred cred;
+  socklen_t size = sizeof(cred);
+  if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &size) != 0 ||
+      size != sizeof(cred))
+    return false;
+
+  return cred.uid == getuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  if (getpeereid(conn, &uid, &gid) != 0)
+    return false;
+
+  return uid == getuid();
+#endif
+}
+
+bool receiveRequest(int conn, std::vector<std::string> &args, int *fds) {
+  uint32_t payloadSize = 0;
+  iovec iov{&payloadSize, sizeof(payloadSize)};
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * forwardedFdCount)];
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t received;
+  do
+    received = recvmsg(conn, &msg, MSG_WAITALL);
+  while (received == -1 && errno == EINTR);
+
+  if (received != sizeof(payloadSize) || payloadSize > maxPayloadSize)
+    return false;
+
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(int) * forwardedFdCount))
+    return false;
+  std::memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * forwardedFdCount);
+
+  std::string payload(payloadSize, '\0');
+  if (!readAll(conn, payload.data(), payload.size()))
+    return false;
+
+  for (size_t begin = 0, end; begin < payload.size(); begin = end + 1) {
+    end = payload.find('\0', begin);
+    if (end == std::string::npos)
+      return false;
+
+    args.emplace_back(payload.substr(begin, end - begin));
+  }
+
+  return !args.empty();
+}
+
+// Runs in a child of the server. The compilation itself happens in yet another
+// child, so that its exit code can be reported even if it terminates through
+// std::exit() or a crash.
+[[noreturn]] void handleRequest(int conn, CompileFn compile) {
+  signal(SIGCHLD, SIG_DFL);
+
+  std::vector<std::string> args;
+  int fds[forwardedFdCount];
+  if (!receiveRequest(conn, args, fds))
+    _exit(1);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(conn);
+
+    for (int i = 0; i < forwardedFdCount; ++i) {
+      dup2(fds[i], i);
+      close(fds[i]);
+    }
+
+    if (chdir(args[0].c_str()) != 0) {
+      std::cerr << "error: failed to enter '" << args[0] << "'\n";
+      std::exit(1);
+    }
+
+    std::vector<const char *> argv;
+    for (size_t i = 1; i < args.size(); ++i)
+      argv.emplace_back(args[i].c_str());
+    argv.emplace_back(nullptr);
+
+    std::exit(compile(argv.size() - 1, argv.data()));
+  }
+
+  int status = 0;
+  while (pid != -1 && waitpid(pid, &status, 0) == -1 && errno == EINTR)
+    ;
+
+  int32_t exitCode = 1;
+  if (pid != -1 && WIFEXITED(status))
+    exitCode = WEXITSTATUS(status);
+  else if (pid != -1 && WIFSIGNALED(status))
+    exitCode = 128 + WTERMSIG(status);
+
+  writeAll(conn, reinterpret_cast<const char *>(&exitCode), sizeof(exitCode));
+  _exit(0);
+}
+} // namespace
+
+int runCompileServer(const std::string &socketPath, CompileFn compile) {
+  sockaddr_un addr;
+  if (!makeAddress(socketPath, addr)) {
+    std::cerr << "error: socket path '" << socketPath << "' is too long\n";
+    return 1;
+  }
+
+  int listenFd = createSocket();
+  if (listenFd == -1) {
+    std::cerr << "error: failed to create socket: " << std::strerror(errno)
+              << '\n';
+    return 1;
+  }
+
+  // The socket file is created with the permissions left by the umask, so
+  // it is restricted while binding to leave no window in which other users
+  // can connect.
+  unlink(socketPath.c_str());
+  mode_t previousMask = umask(S_IRWXG | S_IRWXO | S_IXUSR);
+  bool bound =
+      bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+  umask(previousMask);
+
+  if (!bound || chmod(socketPath.c_str(), S_IRUSR | S_IWUSR) ||
+      listen(listenFd, SOMAXCONN)) {
+    std::cerr << "error: failed to listen on '" << socketPath
+              << "': " << std::strerror(errno) << '\n';
+    close(listenFd);
+    return 1;
+  }
+
+  // Request handlers are never waited for, let the kernel reap them.
+  signal(SIGCHLD, SIG_IGN);
+
+  while (true) {
+    int conn = acceptConnection(listenFd);
+    if (conn == -1) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+
+      std::cerr << "error: failed to accept connection: "
+                << std::strerror(errno) << '\n';
+      close(listenFd);
+      return 1;
+    }
+
+    if (!isPeerTrusted(conn)) {
+      std::cerr << "warning: rejected a connection from another user\n";
+      close(conn);
+      continue;
+    }
+
+    if (fork() == 0) {
+      close(listenFd);
+      handleRequest(conn, compile);
+    }
+
+    close(conn);
+  }
+}
+
+std::optional<int> forwardToCompileServer(const std::string &socketPath,
+                                          llvm::ArrayRef<std::string> args) {
+  sockaddr_un addr;
+  if (!makeAddress(socketPath, addr))
+    return std::nullopt;
+
+  std::string payload = std::filesystem::current_path().string();
+  payload += '\0';
+  for (auto &&arg : args) {
+    payload += arg;
+    payload += '\0';
+  }
+
+  // The server would reject it, compile locally instead.
+  if (payload.size() > maxPayloadSize)
+    return std::nullopt;
+
+  int conn = createSocket();
+  if (conn == -1)
+    return std::nullopt;
+
+  if (connect(conn, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+    close(conn);
+    return std::nullopt;
+  }
+
+  uint32_t payloadSize = payload.size();
+  iovec iov{&payloadSize, sizeof(payloadSize)};
+
+  int fds[forwardedFdCount] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  // Nothing has been sent yet if this fails, so the caller can still
+  // compile locally.
+  if (sendmsg(conn, &msg, 0) != sizeof(payloadSize)) {
+    close(conn);
+    return std::nullopt;
+  }
+
+  int32_t exitCode = 1;
+  if (!writeAll(conn, payload.data(), payload.size()) ||
+      !readAll(conn, reinterpret_cast<char *>(&exitCode), sizeof(exitCode)))
+    exitCode = 1;
+
+  close(conn);
+  return exitCode;
+}
+} // namespace syscall
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "source_manager.h"
+
+namespace syscall {
+
+SourceManager &SourceManager::get() {
+  static SourceManager manager;
+  return manager;
+}
+
+std::optional<uint32_t> SourceManager::addFile(std::string_view path,
+                                               std::string_view buffer) {
+  std::lock_guard<std::mutex> guard(mutex);
+
+  // The extra location is for the end of file. The file goes into the first
+  // gap that is large enough, which is usually the end.
+  uint64_t size = static_cast<uint64_t>(buffer.size()) + 1;
+  uint64_t startOffset = 1;
+  auto it = files.begin();
+  for (; it != files.end(); ++it) {
+    if ((*it)->startOffset - startOffset >= size)
+      break;
+
+    startOffset = (*it)->startOffset + (*it)->buffer.size() + 1;
+  }
+
+  if (it == files.end() && UINT32_MAX - startOffset < size)
+    return std::nullopt;
+
+  auto entry = std::make_unique<FileEntry>();
+  entry->path = path;
+  entry->buffer = buffer;
+  entry->startOffset = startOffset;
+
+  return (*files.emplace(it, std::move(entry)))->startOffset;
+}
+
+void SourceManager::removeFile(uint32_t startOffset) {
+  std::lock_guard<std::mutex> guard(mutex);
+
+  auto it = std::lower_bound(files.begin(), files.end(), startOffset,
+                             [](const auto &file, uint32_t offset) {
+                               return file->startOffset < offset;
+                             });
+  assert(it != files.end() && (*it)->startOffset == startOffset &&
+         "removing a file that isn't registered");
+
+  files.erase(it);
+}
+
+const SourceManager::FileEntry *
+SourceManager::getFileEntry(SourceLocation location) const {
+  // Files are registered in increasing offset order.
+  auto it = std::upper_bound(files.begin(), files.end(), location.offset,
+                             [](uint32_t offset, const auto &file) {
+                               return offset < file->startOffset;
+                             });
+  if (it == files.begin())
+    return nullptr;
+
+  // The location one past the last byte is the end of file.
+  const FileEntry *file = std::prev(it)->get();
+  if (location.offset - file->startOffset > file->buffer.size())
+    return nullptr;
+
+  return file;
+}
+
+PresumedLocation
+SourceManager::getPresumedLocation(SourceLocation location) const {
+  if (!location.isValid())
+    return {"<builtin>", 0, 0};
+
+  // Held until the fields are copied out, so that the file can't be removed
+  // by another thread in the meantime.
+  std::lock_guard<std::mutex> guard(mutex);
+
+  const FileEntry *file = getFileEntry(location);
+  if (!file)
+    return {"<builtin>", 0, 0};
+
+  if (file->lineStarts.empty()) {
+    const char *begin = file->buffer.data();
+    const char *end = begin + file->buffer.size();
+
+    file->lineStarts.emplace_back(0);
+    for (const char *p = begin;
+         (p = static_cast<const char *>(std::memchr(p, '\n', end - p)));)
+      file->lineStarts.emplace_back(++p - begin);
+  }
+
+  uint32_t offset = location.offset - file->startOffset;
+  auto lineStart = std::upper_bound(file->lineStarts.begin(),
+                                    file->lineStarts.end(), offset) -
+                   1;
+
+  return {file->path,
+          static_cast<int>(lineStart - file->lineStarts.begin()) + 1,
+          static_cast<int>(offset - *lineStart) + 1};
+}
+
+} // namespace syscall
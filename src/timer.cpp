@@ -0,0 +1,176 @@
+#include <llvm/Support/Format.h>
+#include <llvm/Support/Process.h>
+
+#include <chrono>
+#include <optional>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "timer.h"
+
+namespace syscall {
+namespace {
+thread_local int nestingDepth = 0;
+
+// Set before any worker thread is started, so the workers only read it.
+std::optional<unsigned> timeTraceGranularity;
+
+void getProcessTimes(double &user, double &system) {
+  llvm::sys::TimePoint<> now;
+  std::chrono::nanoseconds userTime, systemTime;
+  llvm::sys::Process::GetTimeUsage(now, userTime, systemTime);
+
+  user = std::chrono::duration<double>(userTime).count();
+  system = std::chrono::duration<double>(systemTime).count();
+}
+
+#ifdef RUSAGE_THREAD
+double toSeconds(const timeval &time) {
+  return time.tv_sec + time.tv_usec / 1e6;
+}
+#endif
+
+// The CPU time of the calling thread, where the platform can tell it apart
+// from that of the process.
+void getThreadTimes(double &user, double &system) {
+#ifdef RUSAGE_THREAD
+  rusage usage;
+  if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+    user = toSeconds(usage.ru_utime);
+    system = toSeconds(usage.ru_stime);
+    return;
+  }
+#endif
+  getProcessTimes(user, system);
+}
+
+long getPeakRSS() {
+#ifndef _WIN32
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    return usage.ru_maxrss;
+#endif
+  return 0;
+}
+} // namespace
+
+TimingReport &TimingReport::get() {
+  static TimingReport report;
+  return report;
+}
+
+void TimingReport::enable() {
+  enabled = true;
+  startWall = Clock::now();
+  getProcessTimes(startUser, startSystem);
+}
+
+size_t TimingReport::beginSample(std::string_view name, int depth) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  size_t phase = 0;
+  while (phase < phases.size() &&
+         (phases[phase].name != name || phases[phase].depth != depth))
+    ++phase;
+
+  if (phase == phases.size()) {
+    Phase &p = phases.emplace_back();
+    p.name = std::string(name);
+    p.depth = depth;
+  }
+
+  Phase &p = phases[phase];
+  if (p.activeThreads++ == 0)
+    p.activeSince = Clock::now();
+
+  return phase;
+}
+
+void TimingReport::endSample(size_t phase, double user, double system) {
+  long peakRSS = getPeakRSS();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  Phase &p = phases[phase];
+  p.user += user;
+  p.system += system;
+  p.peakRSS = std::max(p.peakRSS, peakRSS);
+
+  if (--p.activeThreads == 0)
+    p.wall += std::chrono::duration<double>(Clock::now() - p.activeSince)
+                  .count();
+}
+
+void TimingReport::print(llvm::raw_ostream &os) const {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  os << "===" << std::string(73, '-') << "===\n"
+     << "                       Syscall compiler phase timing\n"
+     << "===" << std::string(73, '-') << "===\n"
+     << "  User and system time is the CPU time of the threads in the phase,\n"
+     << "  wall time is how long at least one thread was in it. The total is\n"
+     << "  measured for the whole process.\n"
+     << "  Peak RSS is the high-water mark at the end of the phase.\n\n"
+     << "    Wall Time    User Time  System Time   Peak RSS  Phase\n";
+
+  for (auto &&p : phases)
+    os << llvm::format("  %10.4fs  %10.4fs  %10.4fs  %7.1fMB  ", p.wall,
+                       p.user, p.system, p.peakRSS / 1024.0)
+       << std::string(p.depth * 2, ' ') << p.name << '\n';
+
+  double user, system;
+  getProcessTimes(user, system);
+  double wall = std::chrono::duration<double>(Clock::now() - startWall).count();
+
+  os << llvm::format("  %10.4fs  %10.4fs  %10.4fs  %7.1fMB  ", wall,
+                     user - startUser, system - startSystem,
+                     getPeakRSS() / 1024.0)
+     << "Total\n";
+}
+
+PhaseTimerRAII::PhaseTimerRAII(std::string_view name)
+    : traceScope(llvm::StringRef(name.data(), name.size())),
+      active(TimingReport::get().isEnabled()) {
+  if (!active)
+    return;
+
+  phase = TimingReport::get().beginSample(name, nestingDepth++);
+  getThreadTimes(user, system);
+}
+
+PhaseTimerRAII::~PhaseTimerRAII() {
+  if (!active)
+    return;
+
+  --nestingDepth;
+
+  double endUser, endSystem;
+  getThreadTimes(endUser, endSystem);
+  TimingReport::get().endSample(phase, endUser - user, endSystem - system);
+}
+
+int getPhaseNestingDepth() { return nestingDepth; }
+
+PhaseNestingRAII::PhaseNestingRAII(int depth) : savedDepth(nestingDepth) {
+  nestingDepth = depth;
+}
+
+PhaseNestingRAII::~PhaseNestingRAII() { nestingDepth = savedDepth; }
+
+void initializeTimeTrace(unsigned granularity, llvm::StringRef processName) {
+  timeTraceGranularity = granularity;
+  llvm::timeTraceProfilerInitialize(granularity, processName);
+}
+
+TimeTraceThreadRAII::TimeTraceThreadRAII(llvm::StringRef threadName)
+    : active(timeTraceGranularity.has_value()) {
+  if (active)
+    llvm::timeTraceProfilerInitialize(*timeTraceGranularity, threadName);
+}
+
+TimeTraceThreadRAII::~TimeTraceThreadRAII() {
+  if (active)
+    llvm::timeTraceProfilerFinishThread();
+}
+} // namespace syscall
@@ -1,17 +1,40 @@
 #include <cassert>
 #include <iostream>
+#include <sstream>
+#include <utility>
 
 #include "utils.h"
 
 namespace syscall {
+namespace {
+thread_local std::string *diagnosticBuffer = nullptr;
+} // namespace
+
 std::nullptr_t
 report(SourceLocation location, std::string_view message, bool isWarning) {
-  const auto &[file, line, col] = location;
+  const auto &[file, line, col] =
+      SourceManager::get().getPresumedLocation(location);
+
+  assert(!file.empty());
+  std::ostringstream diagnostic;
+  diagnostic << file << ':';
+  // Builtins have no line and column.
+  if (line != 0)
+    diagnostic << line << ':' << col << ':';
+  diagnostic << (isWarning ? " warning: " : " error: ") << message << '\n';
 
-  assert(!file.empty() && line != 0 && col != 0);
-  std::cerr << file << ':' << line << ':' << col << ':'
-            << (isWarning ? " warning: " : " error: ") << message << '\n';
+  if (diagnosticBuffer)
+    *diagnosticBuffer += diagnostic.str();
+  else
+    std::cerr << diagnostic.str();
 
   return nullptr;
 }
+
+DiagnosticBufferRAII::DiagnosticBufferRAII(std::string &buffer)
+    : previousBuffer(std::exchange(diagnosticBuffer, &buffer)) {}
+
+DiagnosticBufferRAII::~DiagnosticBufferRAII() {
+  diagnosticBuffer = previousBuffer;
+}
 } // namespace syscall
\ No newline at end of file